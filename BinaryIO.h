@@ -0,0 +1,92 @@
+#ifndef BINARYIO_H
+#define BINARYIO_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//---------------------------------------------------------------------------------
+// helpers for the compiled-lexer file format: fixed-width values are written
+// in host byte order (the header's magic number catches foreign files), and
+// a reader that runs past the end of its data just stops being ok
+//---------------------------------------------------------------------------------
+class BinaryWriter {
+public:
+    template <class T>
+    void Put(const T value) { PutBytes(&value, sizeof(T)); }
+    void PutString(const std::string& s) {
+        Put<uint32_t>(static_cast<uint32_t>(s.size()));
+        PutBytes(s.data(), s.size());
+    }
+    template <class T>
+    void PutArray(const std::vector<T>& values) { PutBytes(values.data(), values.size() * sizeof(T)); }
+    void PutBytes(const void* data, const size_t size) { out.append(static_cast<const char*>(data), size); }
+
+    const std::string& GetData() const { return out; }
+
+private:
+    std::string out;
+};
+
+class BinaryReader {
+public:
+    explicit BinaryReader(std::string_view data) : in(data) {}
+
+    template <class T>
+    T Get() {
+        T value{};
+        GetBytes(&value, sizeof(T));
+        return value;
+    }
+    std::string GetString() {
+        const uint32_t size = Get<uint32_t>();
+        if (!ok || size > in.size()) {
+            ok = false;
+            return {};
+        }
+        std::string s(in.substr(0, size));
+        in.remove_prefix(size);
+        return s;
+    }
+    template <class T>
+    std::vector<T> GetArray(const size_t count) {
+        if (count > in.size() / sizeof(T)) {
+            ok = false;
+            return {};
+        }
+        std::vector<T> values(count);
+        GetBytes(values.data(), count * sizeof(T));
+        return values;
+    }
+    void GetBytes(void* data, const size_t size) {
+        if (!ok || size > in.size()) {
+            ok = false;
+            return;
+        }
+        std::memcpy(data, in.data(), size);
+        in.remove_prefix(size);
+    }
+
+    bool IsOk() const { return ok; }
+    bool AtEnd() const { return in.empty(); }
+
+private:
+    std::string_view in;
+    bool ok = true;
+};
+
+//---------------------------------------------------------------------------------
+// FNV-1a, 64 bit
+//---------------------------------------------------------------------------------
+inline uint64_t Checksum(std::string_view data) {
+    uint64_t h = 14695981039346656037ull;
+    for (const char c : data) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+#endif
@@ -0,0 +1,67 @@
+#include "BitNFA.h"
+#include <algorithm>
+#include <unordered_set>
+
+using namespace std;
+
+//---------------------------------------------------------------------------------
+// BitNFA ctor: the positions must fit (see Fits)
+//---------------------------------------------------------------------------------
+BitNFA::BitNFA(const PositionAutomaton& positions) : numPositions(static_cast<int>(positions.symbol.size())) {
+    for (int p = 1; p < numPositions; p++) {
+        for (int b = positions.symbol[p].low; b <= positions.symbol[p].high; b++)
+            entered[b] |= uint64_t{1} << p;
+    }
+    for (const int l : positions.last)
+        finals |= uint64_t{1} << l;
+    if (positions.nullable)
+        finals |= 1;
+
+    // one table per byte of the active word, each entry the union of the
+    // follow sets of the bits set in that byte
+    follow.resize((numPositions + 7) / 8);
+    for (size_t k = 0; k < follow.size(); k++) {
+        for (int b = 1; b < 256; b++) {
+            int bit = 0;
+            while (!(b >> bit & 1))
+                bit++;
+            const int p = static_cast<int>(8 * k) + bit;
+            uint64_t own = 0;
+            if (p < numPositions) {
+                for (const int q : positions.follow[p])
+                    own |= uint64_t{1} << q;
+            }
+            follow[k][b] = follow[k][b & (b - 1)] | own;
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------
+// whether the rule's DFA has more than BlowupFactor states per position. the
+// reachable active sets are the DFA's states, so they are explored until
+// there are too many of them
+//---------------------------------------------------------------------------------
+bool BitNFA::BlowsUp() const {
+    // bytes entering the same positions move alike, one of them will do
+    vector<uint64_t> moves;
+    for (const uint64_t e : entered) {
+        if (e != 0 && find(moves.begin(), moves.end(), e) == moves.end())
+            moves.push_back(e);
+    }
+    const size_t limit = BlowupFactor * static_cast<size_t>(numPositions);
+    unordered_set<uint64_t> seen{GetStartState()};
+    vector<uint64_t> pending{GetStartState()};
+    while (!pending.empty()) {
+        const uint64_t follows = Follows(pending.back());
+        pending.pop_back();
+        for (const uint64_t e : moves) {
+            const uint64_t next = follows & e;
+            if (next == 0 || !seen.insert(next).second)
+                continue;
+            if (seen.size() > limit)
+                return true;
+            pending.push_back(next);
+        }
+    }
+    return false;
+}
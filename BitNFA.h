@@ -0,0 +1,50 @@
+#ifndef BITNFA_H
+#define BITNFA_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "shunting.h"
+
+//---------------------------------------------------------------------------------
+// class BitNFA
+// bit-parallel simulation of a position automaton with at most 64 positions:
+// the active positions are the bits of one word, and a move is
+//     active = follow(active) & entered[byte]
+// where follow(active) ORs together precomputed follow sets of each byte of
+// the active word. nothing is determinized, so building one is nearly free,
+// which pays off for the rules whose DFA would blow up; every other rule
+// belongs in the combined DFA, scanned once per token for all rules
+//---------------------------------------------------------------------------------
+class BitNFA {
+public:
+    static constexpr size_t MaxPositions = 64;
+    static constexpr size_t BlowupFactor = 4; // DFA states per position a rule may take before it BlowsUp
+
+    static bool Fits(const PositionAutomaton& positions) { return positions.symbol.size() <= MaxPositions; }
+    explicit BitNFA(const PositionAutomaton& positions);
+
+    uint64_t GetStartState() const { return 1; }
+    uint64_t Next(const uint64_t active, const char c) const {
+        return Follows(active) & entered[static_cast<unsigned char>(c)];
+    }
+    bool IsAccepting(const uint64_t active) const { return (active & finals) != 0; }
+    bool CanStart(const unsigned char c) const { return (follow[0][1] & entered[c]) != 0; }
+    int NumPositions() const { return numPositions; }
+    bool BlowsUp() const;
+
+private:
+    uint64_t Follows(const uint64_t active) const {
+        uint64_t follows = 0;
+        for (size_t k = 0; k < follow.size(); k++)
+            follows |= follow[k][(active >> (8 * k)) & 0xFF];
+        return follows;
+    }
+
+    std::array<uint64_t, 256> entered{};           // positions whose symbol is the byte
+    std::vector<std::array<uint64_t, 256>> follow; // follow[k][b]: positions following any bit of b at byte k
+    uint64_t finals = 0;
+    int numPositions;
+};
+
+#endif
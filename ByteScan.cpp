@@ -0,0 +1,109 @@
+#include "ByteScan.h"
+#include <cctype>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define BYTESCAN_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+void ByteSet::Add(const unsigned char b) {
+    member[b] = true;
+    lowNibble[b >> 7][b & 15] |= static_cast<unsigned char>(1 << ((b >> 4) & 7));
+}
+
+ByteSet ByteSet::Complement() const {
+    ByteSet complement;
+    for (int b = 0; b < 256; b++) {
+        if (!member[b])
+            complement.Add(static_cast<unsigned char>(b));
+    }
+    return complement;
+}
+
+// the bytes isspace accepts in the C locale
+static const ByteSet& NonSpaces() {
+    static const ByteSet nonSpaces = [] {
+        ByteSet spaces;
+        for (int b = 0; b < 256; b++) {
+            if (isspace(b))
+                spaces.Add(static_cast<unsigned char>(b));
+        }
+        return spaces.Complement();
+    }();
+    return nonSpaces;
+}
+
+#ifdef BYTESCAN_X86
+static bool HasAVX2() {
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+}
+
+//---------------------------------------------------------------------------------
+// 32 bytes at a time: shuffle each byte's low nibble through the table for its
+// top bit, then keep the bit selected by the rest of its high nibble. returns
+// the number of whole blocks' bytes scanned if no member was found
+//---------------------------------------------------------------------------------
+__attribute__((target("avx2")))
+static size_t FindFirstOfAVX2(const char* data, const size_t size, const unsigned char (&lowNibble)[2][16]) {
+    const __m256i low = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(lowNibble[0])));
+    const __m256i high = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(lowNibble[1])));
+    const __m256i bits = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+                                          1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    const __m256i topBit = _mm256_set1_epi8(-128);
+    const __m256i sevens = _mm256_set1_epi8(7);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        // a shuffle index with its top bit set yields 0, so each table only answers for its half
+        const __m256i rows = _mm256_or_si256(_mm256_shuffle_epi8(low, v),
+                                             _mm256_shuffle_epi8(high, _mm256_xor_si256(v, topBit)));
+        const __m256i column = _mm256_shuffle_epi8(bits, _mm256_and_si256(_mm256_srli_epi16(v, 4), sevens));
+        const __m256i miss = _mm256_cmpeq_epi8(_mm256_and_si256(rows, column), _mm256_setzero_si256());
+        const unsigned hits = ~static_cast<unsigned>(_mm256_movemask_epi8(miss));
+        if (hits)
+            return i + __builtin_ctz(hits);
+    }
+    return i;
+}
+
+//---------------------------------------------------------------------------------
+// 16 bytes at a time with plain SSE2: a byte is whitespace if it is ' ' or
+// lies in '\t'..'\r'
+//---------------------------------------------------------------------------------
+static size_t SkipSpacesSSE2(const char* data, const size_t size) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i span = _mm_set1_epi8('\r' - '\t');
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        const __m128i offset = _mm_sub_epi8(v, tab);
+        const __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(offset, span), offset);
+        const unsigned spaces = static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, space), control)));
+        if (spaces != 0xFFFF)
+            return i + __builtin_ctz(~spaces);
+    }
+    return i;
+}
+#endif
+
+size_t FindFirstOf(const string_view text, size_t from, const ByteSet& set) {
+#ifdef BYTESCAN_X86
+    if (from < text.size() && HasAVX2())
+        from += FindFirstOfAVX2(text.data() + from, text.size() - from, set.lowNibble);
+#endif
+    while (from < text.size() && !set.Contains(static_cast<unsigned char>(text[from])))
+        from++;
+    return from;
+}
+
+size_t SkipSpaces(const string_view text, size_t from) {
+#ifdef BYTESCAN_X86
+    if (from < text.size() && !HasAVX2())
+        from += SkipSpacesSSE2(text.data() + from, text.size() - from);
+#endif
+    return FindFirstOf(text, from, NonSpaces());
+}
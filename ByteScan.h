@@ -0,0 +1,35 @@
+#ifndef BYTESCAN_H
+#define BYTESCAN_H
+
+#include <array>
+#include <cstddef>
+#include <string_view>
+
+//---------------------------------------------------------------------------------
+// class ByteSet
+// a set of byte values, kept with the nibble tables the vectorized search
+// looks bytes up in: bit (hi & 7) of lowNibble[hi >> 3][lo] is set when the
+// byte hi:lo is in the set
+//---------------------------------------------------------------------------------
+class ByteSet {
+public:
+    void Add(unsigned char b);
+    bool Contains(unsigned char b) const { return member[b]; }
+    ByteSet Complement() const;
+
+private:
+    friend size_t FindFirstOf(std::string_view text, size_t from, const ByteSet& set);
+
+    std::array<bool, 256> member{};
+    alignas(16) unsigned char lowNibble[2][16] = {};
+};
+
+//---------------------------------------------------------------------------------
+// position of the first byte at or after `from` that is in the set (or is not
+// whitespace), text.size() if there is none. uses AVX2 when the CPU has it,
+// SSE2 for whitespace on any x86-64, and a byte loop elsewhere
+//---------------------------------------------------------------------------------
+size_t FindFirstOf(std::string_view text, size_t from, const ByteSet& set);
+size_t SkipSpaces(std::string_view text, size_t from);
+
+#endif
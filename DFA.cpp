@@ -1,60 +1,295 @@
 #include "DFA.h"
 #include <iostream>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include "NFA.h"
 using namespace std;
 
 //---------------------------------------------------------------------------------
 // DFA ctor
 //---------------------------------------------------------------------------------
 DFA::DFA(set<char> A, set<int> I, set<int> F) : alpha(A), init_states(I), fin_states(F) {
-    Reset();
+    start_state = *init_states.begin();
+    Compile();
 }
 
 //---------------------------------------------------------------------------------
-// reset the DFA to its start config
+// flatten Dtran into a dense table with a parallel accept array, so a move
+// costs two indexed loads instead of two tree lookups. bytes whose columns are
+// identical (every state moves the same way on them) share one equivalence
+// class, and the table has a column per class rather than per byte.
+// must be called again after adding transitions
 //---------------------------------------------------------------------------------
-void DFA::Reset() {
-    status = START;
-    current_state = *init_states.begin();
-    accepted = false;
-    lexeme.clear();
-    accepted_lexeme.clear();
+void DFA::Compile() {
+    // states are numbered densely from 0, so the largest label fixes the row count
+    int num_states = start_state + 1;
+    for (const auto& row : Dtran) {
+        num_states = max(num_states, row.first + 1);
+        for (const auto& transition : row.second)
+            num_states = max(num_states, transition.second + 1);
+    }
+    for (const int f : fin_states)
+        num_states = max(num_states, f + 1);
+
+    // one column of targets per byte
+    vector<vector<int>> columns(256, vector<int>(num_states, -1));
+    for (const auto& row : Dtran) {
+        for (const auto& transition : row.second)
+            columns[static_cast<unsigned char>(transition.first)][row.first] = transition.second;
+    }
+    // number the distinct columns in byte order, those are the classes
+    map<vector<int>, int> classOf;
+    vector<int> representative; // a byte of each class
+    for (int b = 0; b < 256; b++) {
+        const auto [it, inserted] = classOf.emplace(columns[b], static_cast<int>(representative.size()));
+        if (inserted)
+            representative.push_back(b);
+        byte_class[b] = static_cast<unsigned char>(it->second);
+    }
+    num_classes = static_cast<int>(representative.size());
+
+    table.assign(static_cast<size_t>(num_states) * num_classes, -1);
+    accept_token.assign(num_states, -1);
+    for (int s = 0; s < num_states; s++) {
+        for (int k = 0; k < num_classes; k++)
+            table[s * num_classes + k] = columns[representative[k]][s];
+    }
+    for (const int f : fin_states) {
+        const auto it = fin_tokens.find(f);
+        accept_token[f] = it == fin_tokens.end() ? 0 : it->second;
+    }
 }
 
 //---------------------------------------------------------------------------------
-// process a single input character: update the current state,
-// accumulate the lexeme, and update the DFA status (ACCEPT, POTENTIAL, FAIL)
+// minimize the DFA with Hopcroft's partition refinement, O(n log n) per symbol.
+// final states are only merged if they accept the same token, and states that
+// can never reach a final state are dropped (their moves become FAIL).
+// returns the number of states removed
 //---------------------------------------------------------------------------------
-void DFA::Move(char c) {
-    //---- check if c is in the map for transitions
-    if (Dtran[current_state].find(c) != Dtran[current_state].end()) {
-        current_state = Dtran[current_state][c];
-        lexeme.push_back(c);
+int DFA::Minimize() {
+    const int n = NumStates();
+    const int sink = n;          // implicit dead state for missing transitions
+    const int total = n + 1;
+    const vector<char> symbols(alpha.begin(), alpha.end());
+
+    // inverse transitions per symbol: pre[a][t] lists the states moving to t on symbols[a]
+    vector<vector<vector<int>>> pre(symbols.size(), vector<vector<int>>(total));
+    for (size_t a = 0; a < symbols.size(); a++) {
+        for (int s = 0; s < total; s++) {
+            const int t = s == sink ? sink : Next(s, symbols[a]);
+            pre[a][t < 0 ? sink : t].push_back(s);
+        }
+    }
 
-        // if we reach a final state, mark as ACCEPT
-        if (fin_states.find(current_state) != fin_states.end()) {
-            status = ACCEPT;
-            accepted = true;
-            accepted_lexeme = lexeme;
-        } else {
-            status = POTENTIAL;
+    // refinable partition: elems is grouped by block, each block owns [first, past),
+    // and the marked states of a block are kept at its front
+    vector<int> elems(total), loc(total), block(total);
+    vector<int> first, past, marked;
+    map<int, int> blockOfToken;  // initial blocks: one per accepted token, -1 for non-final
+    for (int s = 0; s < total; s++) {
+        const int token = s == sink ? -1 : accept_token[s];
+        if (blockOfToken.find(token) == blockOfToken.end()) {
+            blockOfToken[token] = static_cast<int>(first.size());
+            first.push_back(0);
+            past.push_back(0);
+            marked.push_back(0);
+        }
+        block[s] = blockOfToken[token];
+        past[block[s]]++;
+    }
+    for (size_t b = 1; b < first.size(); b++) {
+        first[b] = past[b - 1];
+        past[b] += first[b];
+    }
+    {
+        vector<int> fill(first);
+        for (int s = 0; s < total; s++) {
+            elems[fill[block[s]]] = s;
+            loc[s] = fill[block[s]]++;
         }
-    } else {
-        // no transition on input c, mark as FAIL
-        status = FAIL;
     }
+
+    // every initial block but the largest one is a splitter
+    vector<int> worklist;
+    vector<char> inWorklist(first.size(), 0);
+    int largest = 0;
+    for (size_t b = 0; b < first.size(); b++) {
+        if (past[b] - first[b] > past[largest] - first[largest])
+            largest = static_cast<int>(b);
+    }
+    for (size_t b = 0; b < first.size(); b++) {
+        if (static_cast<int>(b) != largest) {
+            worklist.push_back(static_cast<int>(b));
+            inWorklist[b] = 1;
+        }
+    }
+
+    vector<int> touched;
+    while (!worklist.empty()) {
+        const int splitter = worklist.back();
+        worklist.pop_back();
+        inWorklist[splitter] = 0;
+        const vector<int> members(elems.begin() + first[splitter], elems.begin() + past[splitter]);
+
+        for (size_t a = 0; a < symbols.size(); a++) {
+            // mark every state that moves into the splitter on this symbol
+            for (const int t : members) {
+                for (const int s : pre[a][t]) {
+                    const int b = block[s];
+                    const int pos = first[b] + marked[b];
+                    if (loc[s] < pos)
+                        continue; // already marked
+                    if (marked[b] == 0)
+                        touched.push_back(b);
+                    swap(elems[loc[s]], elems[pos]);
+                    loc[elems[loc[s]]] = loc[s];
+                    loc[s] = pos;
+                    marked[b]++;
+                }
+            }
+            // split each touched block into its marked and unmarked parts
+            for (const int b : touched) {
+                const int split = first[b] + marked[b];
+                marked[b] = 0;
+                if (split == past[b])
+                    continue; // all states moved the same way
+                const int nb = static_cast<int>(first.size());
+                first.push_back(first[b]);
+                past.push_back(split);
+                marked.push_back(0);
+                inWorklist.push_back(0);
+                first[b] = split;
+                for (int i = first[nb]; i < past[nb]; i++)
+                    block[elems[i]] = nb;
+                // Hopcroft's trick: only the smaller half needs to become a splitter,
+                // unless the old block was still waiting, then both halves are
+                if (inWorklist[b] || past[nb] - first[nb] <= past[b] - first[b]) {
+                    worklist.push_back(nb);
+                    inWorklist[nb] = 1;
+                }
+                if (!inWorklist[b] && past[b] - first[b] < past[nb] - first[nb]) {
+                    worklist.push_back(b);
+                    inWorklist[b] = 1;
+                }
+            }
+            touched.clear();
+        }
+    }
+
+    // renumber the blocks breadth first from the start block, dropping the dead block
+    const int deadBlock = block[sink];
+    vector<int> newState(first.size(), -1);
+    vector<int> order;
+    newState[block[start_state]] = 0;
+    order.push_back(start_state);
+    for (size_t i = 0; i < order.size(); i++) {
+        for (const char c : symbols) {
+            const int t = Next(order[i], c);
+            if (t < 0 || block[t] == deadBlock || newState[block[t]] >= 0)
+                continue;
+            newState[block[t]] = static_cast<int>(order.size());
+            order.push_back(t);
+        }
+    }
+
+    // rebuild the DFA from one representative per block
+    map<int, map<char, int>> minTran;
+    set<int> minFinal;
+    map<int, int> minTokens;
+    for (size_t i = 0; i < order.size(); i++) {
+        const int rep = order[i];
+        for (const char c : symbols) {
+            const int t = Next(rep, c);
+            if (t >= 0 && block[t] != deadBlock)
+                minTran[static_cast<int>(i)][c] = newState[block[t]];
+        }
+        if (IsAccepting(rep)) {
+            minFinal.insert(static_cast<int>(i));
+            minTokens[static_cast<int>(i)] = accept_token[rep];
+        }
+    }
+    Dtran = minTran;
+    fin_states = minFinal;
+    fin_tokens = minTokens;
+    init_states = {0};
+    start_state = 0;
+    Compile();
+
+    return n - NumStates();
 }
 
 //---------------------------------------------------------------------------------
-// run the DFA over an entire input string
+// the DFA running every part side by side: a state is the tuple of the parts'
+// states (-1 once a part has failed), accepting the lowest token any of them
+// accepts, and only tuples reachable from the start are built. each part's
+// tokens must already be numbered for the whole spec. much cheaper than subset
+// construction of the parts' NFAs together, so the parts can be determinized
+// independently (and in parallel) and combined here
 //---------------------------------------------------------------------------------
-bool DFA::Run(const string& input) {
-    Reset();
-    for (const char c : input) {
-        Move(c);
-        if (status == FAIL)
-            break;
+DFA DFA::Product(const vector<DFA>& parts) {
+    // bytes that are in the same class in every part move every tuple alike
+    map<vector<unsigned char>, int> classOf;
+    vector<vector<unsigned char>> partClasses; // each part's class of each joint class
+    vector<vector<char>> bytesOf;              // the bytes of each joint class
+    for (int b = 0; b < 256; b++) {
+        vector<unsigned char> key(parts.size());
+        for (size_t k = 0; k < parts.size(); k++)
+            key[k] = parts[k].byte_class[b];
+        const auto [it, inserted] = classOf.emplace(key, static_cast<int>(partClasses.size()));
+        if (inserted) {
+            partClasses.push_back(key);
+            bytesOf.emplace_back();
+        }
+        bytesOf[it->second].push_back(static_cast<char>(b));
+    }
+
+    DFA product;
+    product.init_states = {0};
+    unordered_map<vector<int>, int, SubsetHash> stateOf;
+    vector<vector<int>> tuples;
+    auto stateOfTuple = [&](vector<int>&& tuple) {
+        const auto [it, inserted] = stateOf.emplace(tuple, static_cast<int>(tuples.size()));
+        if (inserted) {
+            int token = -1;
+            for (size_t k = 0; k < parts.size(); k++) {
+                const int t = tuple[k] < 0 ? -1 : parts[k].accept_token[tuple[k]];
+                if (t >= 0 && (token < 0 || t < token))
+                    token = t;
+            }
+            if (token >= 0) {
+                product.fin_states.insert(it->second);
+                product.fin_tokens[it->second] = token;
+            }
+            tuples.push_back(std::move(tuple));
+        }
+        return it->second;
+    };
+    vector<int> start(parts.size());
+    for (size_t k = 0; k < parts.size(); k++)
+        start[k] = parts[k].start_state;
+    stateOfTuple(std::move(start));
+
+    for (size_t i = 0; i < tuples.size(); i++) {
+        const vector<int> current = tuples[i]; // tuples grows below
+        for (size_t c = 0; c < partClasses.size(); c++) {
+            vector<int> next(parts.size());
+            bool alive = false;
+            for (size_t k = 0; k < parts.size(); k++) {
+                next[k] = current[k] < 0 ? -1 : parts[k].table[current[k] * parts[k].num_classes + partClasses[c][k]];
+                alive = alive || next[k] >= 0;
+            }
+            if (!alive)
+                continue;
+            const int target = stateOfTuple(std::move(next));
+            for (const char b : bytesOf[c]) {
+                product.Dtran[static_cast<int>(i)][b] = target;
+                product.alpha.insert(b);
+            }
+        }
     }
-    return accepted;
+    product.Compile();
+    return product;
 }
 
 //---------------------------------------------------------------------------------
@@ -70,10 +305,96 @@ void DFA::Print() const {
         cout << endl;
     }
 }
+//---------------------------------------------------------------------------------
+// write the compiled form (start state, accept tokens, transition table)
+//---------------------------------------------------------------------------------
+void DFA::Save(BinaryWriter& out) const {
+    out.Put<int32_t>(start_state);
+    out.Put<uint32_t>(static_cast<uint32_t>(NumStates()));
+    out.Put<uint32_t>(static_cast<uint32_t>(num_classes));
+    out.PutArray(byte_class);
+    out.PutArray(accept_token);
+    out.PutArray(table);
+}
+
+//---------------------------------------------------------------------------------
+// read a compiled form written by Save. only the tables are restored, not
+// Dtran, so a loaded DFA scans and minimizes but prints no transitions
+//---------------------------------------------------------------------------------
+bool DFA::Load(BinaryReader& in) {
+    const int start = in.Get<int32_t>();
+    const uint32_t num_states = in.Get<uint32_t>();
+    const uint32_t classes = in.Get<uint32_t>();
+    vector<unsigned char> classes_of = in.GetArray<unsigned char>(256);
+    vector<int> accepts = in.GetArray<int>(num_states);
+    vector<int> transitions = in.GetArray<int>(static_cast<size_t>(num_states) * classes);
+    if (!in.IsOk() || start < 0 || start >= static_cast<int>(num_states) || classes == 0 || classes > 256)
+        return false;
+    for (const unsigned char k : classes_of) {
+        if (k >= classes)
+            return false;
+    }
+    for (const int t : transitions) {
+        if (t < -1 || t >= static_cast<int>(num_states))
+            return false;
+    }
+
+    Dtran.clear();
+    num_classes = static_cast<int>(classes);
+    byte_class = std::move(classes_of);
+    table = std::move(transitions);
+    accept_token = std::move(accepts);
+    start_state = start;
+    init_states = {start};
+    fin_states.clear();
+    fin_tokens.clear();
+    for (int s = 0; s < NumStates(); s++) {
+        if (IsAccepting(s)) {
+            fin_states.insert(s);
+            fin_tokens[s] = accept_token[s];
+        }
+    }
+    // the alphabet is every byte whose class has at least one transition
+    vector<char> used(num_classes, 0);
+    for (size_t i = 0; i < table.size(); i++) {
+        if (table[i] >= 0)
+            used[i % num_classes] = 1;
+    }
+    alpha.clear();
+    for (int c = 0; c < 256; c++) {
+        if (used[byte_class[c]])
+            alpha.insert(static_cast<char>(c));
+    }
+    return true;
+}
+
+// byte transitions of the compiled table: each class move stands for every byte in the class
+size_t DFA::NumTransitions() const {
+    vector<size_t> classSize(num_classes, 0);
+    for (const unsigned char k : byte_class)
+        classSize[k]++;
+    size_t count = 0;
+    for (size_t i = 0; i < table.size(); i++) {
+        if (table[i] >= 0)
+            count += classSize[i % num_classes];
+    }
+    return count;
+}
+
+// one tree node per state and per (state, symbol); a std::map node carries
+// three pointers and a color besides its value
+size_t DFA::DtranBytes() const {
+    constexpr size_t node = 4 * sizeof(void*);
+    size_t bytes = 0;
+    for (const auto& row : Dtran)
+        bytes += node + sizeof(row) + row.second.size() * (node + sizeof(pair<const char, int>));
+    return bytes;
+}
+
 //---------------------------------------------------------------------------------
 // check if the DFA accepts the empty string
 //---------------------------------------------------------------------------------
 bool DFA::AcceptsEmpty() const {
     // check if initial state state is in the set of final states
-    return (fin_states.find(*init_states.begin()) != fin_states.end());
+    return IsAccepting(start_state);
 }
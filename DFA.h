@@ -4,6 +4,9 @@
 #include <set>
 #include <map>
 #include <string>
+#include <string_view>
+#include <vector>
+#include "BinaryIO.h"
 
 using namespace std;
 
@@ -12,34 +15,115 @@ enum DFAstatus { START, FAIL, POTENTIAL, ACCEPT };
 //---------------------------------------------------------------------------------
 // class DFA
 // (S, Σ, δ, s0, F)
+// once compiled a DFA is immutable, so one instance can be scanned by any
+// number of Matchers (and threads) at the same time
 //---------------------------------------------------------------------------------
 class DFA {
 public:
     DFA() {}
     DFA(set<char> A, set<int> I, set<int> F);
-    void Reset();
 
     void AddTransition(int src, int dst, char sym) { Dtran[src][sym] = dst; }
-    void Move(char c);
-    bool Run(const std::string& input);
-    DFAstatus GetStatus() { return status; }
-    string GetAcceptedLexeme() { return accepted_lexeme; }
-    bool GetAccepted() { return accepted; }
+    void SetAcceptToken(int fstate, int token) { fin_tokens[fstate] = token; }
+    void Compile();
+    int Minimize();
+    static DFA Product(const std::vector<DFA>& parts);
     void Print() const;
+    void Save(BinaryWriter& out) const;
+    bool Load(BinaryReader& in);
 
     bool AcceptsEmpty() const;
 
+    // table-driven stepping over the compiled form (see Compile)
+    int GetStartState() const { return start_state; }
+    int Next(int state, char c) const { return table[state * num_classes + byte_class[static_cast<unsigned char>(c)]]; }
+    bool IsAccepting(int state) const { return accept_token[state] >= 0; }
+    int GetAcceptToken(int state) const { return accept_token[state]; }
+    int NumStates() const { return static_cast<int>(accept_token.size()); }
+    int NumClasses() const { return num_classes; }
+    size_t NumTransitions() const;
+    size_t DtranBytes() const; // approximate heap footprint of Dtran
+    size_t TableBytes() const { return (table.size() + accept_token.size()) * sizeof(int) + byte_class.size(); }
+
 private:
     std::map<int, std::map<char, int>> Dtran;
-    DFAstatus status;
-    int current_state;
-    bool accepted;
-    std::string lexeme;
-    std::string accepted_lexeme;
+    std::vector<int> table;        // compiled Dtran: states x byte classes, -1 means no transition
+    std::vector<unsigned char> byte_class = std::vector<unsigned char>(256, 0); // byte -> equivalence class
+    int num_classes = 1;           // bytes in one class move every state to the same place
+    std::vector<int> accept_token; // token accepted in each state, -1 for non-final states
+    int start_state = 0;
 
     std::set<char> alpha;      // set of input symbols in the alphabet
     std::set<int> init_states; // initial state of the DFA
     std::set<int> fin_states;  // final states of the DFA
+    std::map<int, int> fin_tokens; // token of each final state when several are merged, default 0
 };
 
-#endif
\ No newline at end of file
+//---------------------------------------------------------------------------------
+// class Matcher
+// the run state of one scan over an automaton (a const DFA, or a LazyDFA):
+// current state, status, and the length and token of the longest accepted
+// prefix. lexemes are not copied, the caller slices its own input
+//---------------------------------------------------------------------------------
+template <class Automaton>
+class Matcher {
+public:
+    explicit Matcher(Automaton& dfa) : dfa(dfa) { Reset(); }
+
+    //---- reset to the start config
+    void Reset() {
+        status = START;
+        current_state = dfa.GetStartState();
+        length = 0;
+        accepted_length = 0;
+        accepted_token = -1;
+    }
+
+    //---- process a single input character and update the status (ACCEPT, POTENTIAL, FAIL)
+    void Move(char c) {
+        if (const int next = dfa.Next(current_state, c); next >= 0) {
+            current_state = next;
+            length++;
+            // if we reach a final state, mark as ACCEPT
+            if (dfa.IsAccepting(current_state)) {
+                status = ACCEPT;
+                accepted_length = length;
+                accepted_token = dfa.GetAcceptToken(current_state);
+            } else {
+                status = POTENTIAL;
+            }
+        } else {
+            // no transition on input c, mark as FAIL
+            status = FAIL;
+        }
+    }
+
+    //---- run over an entire input string, true if any prefix was accepted
+    bool Run(std::string_view input) {
+        Reset();
+        for (const char c : input) {
+            Move(c);
+            if (status == FAIL)
+                break;
+        }
+        return GetAccepted();
+    }
+
+    DFAstatus GetStatus() const { return status; }
+    int GetState() const { return current_state; }
+    bool GetAccepted() const { return accepted_token >= 0; }
+    size_t GetAcceptedLength() const { return accepted_length; }
+    int GetAcceptedToken() const { return accepted_token; }
+
+private:
+    Automaton& dfa;
+    DFAstatus status;
+    int current_state;
+    size_t length;          // characters consumed since Reset
+    size_t accepted_length; // length of the longest accepted prefix
+    int accepted_token;     // token of that prefix, -1 if none
+};
+
+using DFAMatcher = Matcher<const DFA>;
+
+#endif
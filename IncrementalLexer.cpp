@@ -0,0 +1,101 @@
+#include "IncrementalLexer.h"
+#include <algorithm>
+
+using namespace std;
+
+IncrementalLexer::IncrementalLexer(shared_ptr<const LexerSpec> spec, string text, const LexerOptions& options)
+    : spec(std::move(spec)), options(options), text(std::move(text)) {
+    // the dead-end memo would hide how far a scan really looked
+    this->options.linear = false;
+    for (const Span& span : Lex(0, [](size_t) { return false; }))
+        PushBefore(span);
+}
+
+template <class Stop>
+vector<IncrementalLexer::Span> IncrementalLexer::Lex(const size_t start, Stop&& stop) const {
+    vector<Span> lexed;
+    Lexer lexer(spec, text, start, options);
+    for (size_t steps = 0;; steps = lexer.scanStats.steps) {
+        const Token token = lexer.getToken();
+        if (token.id == Token::EOS || stop(token.offset))
+            break;
+        // an INVALID byte skipped without a scan still looked at itself
+        size_t scanned = max<size_t>(lexer.scanStats.steps - steps, 1);
+        if (token.offset + scanned >= text.size())
+            scanned = string::npos;
+        lexed.push_back({token.offset, token.lexeme.size(), scanned, token.id});
+    }
+    return lexed;
+}
+
+void IncrementalLexer::PushBefore(const Span& span) {
+    const size_t lookahead = span.scanned == string::npos ? text.size() + 1 : span.offset + span.scanned;
+    reach.push_back(max(lookahead, reach.empty() ? 0 : reach.back()));
+    before.push_back(span);
+}
+
+void IncrementalLexer::MoveGap(const size_t offset) {
+    while (!before.empty() && before.back().offset >= offset) {
+        after.push_back({text.size() - before.back().offset, before.back().length, before.back().scanned, before.back().id});
+        before.pop_back();
+        reach.pop_back();
+    }
+    while (!after.empty() && text.size() - after.back().offset < offset) {
+        PushBefore({text.size() - after.back().offset, after.back().length, after.back().scanned, after.back().id});
+        after.pop_back();
+    }
+}
+
+size_t IncrementalLexer::Edit(size_t offset, size_t removed, const string_view inserted) {
+    offset = min(offset, text.size());
+    removed = min(removed, text.size() - offset);
+    MoveGap(offset);
+    text.replace(offset, removed, inserted);
+    const size_t editEnd = offset + inserted.size(); // end of the edit in the new text
+
+    // tokens whose scan stopped before the edit are kept; lexing restarts
+    // at the end of the last of them (before any whitespace, which the edit
+    // may have changed)
+    const size_t first = upper_bound(reach.begin(), reach.end(), offset) - reach.begin();
+    const size_t restart = first ? before[first - 1].offset + before[first - 1].length : 0;
+
+    // tokens behind the gap started after the removed bytes and their distance
+    // from the end is unchanged; lexing stops at the first new token that
+    // starts where one of them starts
+    size_t resume = 0; // how many tokens behind the gap are kept
+    vector<Span> lexed = Lex(restart, [&](const size_t start) {
+        if (start < editEnd)
+            return false;
+        const size_t fromEnd = text.size() - start;
+        const auto same = lower_bound(after.begin(), after.end(), fromEnd,
+            [](const Span& span, const size_t distance) { return span.offset < distance; });
+        if (same == after.end() || same->offset != fromEnd)
+            return false;
+        resume = static_cast<size_t>(same - after.begin()) + 1;
+        return true;
+    });
+
+    // splice: kept prefix, re-lexed span, reused suffix
+    before.resize(first);
+    reach.resize(first);
+    for (const Span& span : lexed)
+        PushBefore(span);
+    after.resize(resume);
+    return lexed.size();
+}
+
+Token IncrementalLexer::GetToken(const size_t i) const {
+    Span span = i < before.size() ? before[i] : after[after.size() - 1 - (i - before.size())];
+    if (i >= before.size())
+        span.offset = text.size() - span.offset;
+    const string_view name = span.id == Token::INVALID ? "INVALID" : string_view(spec->GetTokenName(span.id));
+    return {span.id, name, string_view(text).substr(span.offset, span.length), span.offset};
+}
+
+vector<Token> IncrementalLexer::GetTokens() const {
+    vector<Token> tokens;
+    tokens.reserve(NumTokens());
+    for (size_t i = 0; i < NumTokens(); i++)
+        tokens.push_back(GetToken(i));
+    return tokens;
+}
@@ -0,0 +1,57 @@
+#ifndef INCREMENTALLEXER_H
+#define INCREMENTALLEXER_H
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "lexer.h"
+
+//---------------------------------------------------------------------------------
+// class IncrementalLexer
+// a document and its token stream, kept up to date across edits. an edit only
+// re-lexes from the last token whose scan did not look at the edited bytes,
+// and stops as soon as a new token starts where an old token after the edit
+// started: every scan begins in the start state, so from there on the old
+// tokens are reused. lexing work scales with the edit, not the document
+//---------------------------------------------------------------------------------
+class IncrementalLexer {
+public:
+    IncrementalLexer(std::shared_ptr<const LexerSpec> spec, std::string text, const LexerOptions& options = LexerOptions());
+
+    // replace `removed` bytes at `offset` with `inserted`; returns the number of tokens lexed again
+    size_t Edit(size_t offset, size_t removed, std::string_view inserted);
+
+    const std::string& GetText() const { return text; }
+    size_t NumTokens() const { return before.size() + after.size(); }
+    Token GetToken(size_t i) const; // valid until the next edit
+    std::vector<Token> GetTokens() const;
+
+private:
+    struct Span {
+        size_t offset;  // before the gap: from the start of the text; after it: from the end
+        size_t length;
+        size_t scanned; // bytes the scan examined from the token start, npos if it reached the end
+        int id;
+    };
+
+    // lex from `start` until the end of the text, or until a token starts at
+    // a position `stop` accepts
+    template <class Stop>
+    std::vector<Span> Lex(size_t start, Stop&& stop) const;
+    // move the tokens starting before `offset` in front of the gap, the rest behind it
+    void MoveGap(size_t offset);
+    void PushBefore(const Span& span);
+
+    std::shared_ptr<const LexerSpec> spec;
+    LexerOptions options;
+    std::string text;
+    // the token stream split at a gap that follows the edits: tokens after it
+    // are kept last-first and positioned from the end, so an edit in front of
+    // them leaves them untouched
+    std::vector<Span> before;
+    std::vector<Span> after;
+    std::vector<size_t> reach; // reach[i]: furthest position examined by the scans of before[0..i]
+};
+
+#endif
@@ -0,0 +1,92 @@
+#include "LazyDFA.h"
+#include <algorithm>
+
+using namespace std;
+
+//---------------------------------------------------------------------------------
+// LazyDFA ctor: seed the cache with the start state
+//---------------------------------------------------------------------------------
+LazyDFA::LazyDFA(const FlatNFA& nfa, const size_t cacheBytes) : nfa(nfa), cacheBytes(cacheBytes) {
+    stamp.assign(nfa.closure.size(), -1);
+    StateOf(vector<int>(nfa.closure[nfa.init_state]));
+}
+
+//---------------------------------------------------------------------------------
+// take the move from state on c, building the target state if it isn't cached
+//---------------------------------------------------------------------------------
+int LazyDFA::Next(const int state, const char c) {
+    const int k = nfa.byteClass[static_cast<unsigned char>(c)];
+    const int cached = states[state].next[k];
+    if (cached != UNKNOWN)
+        return cached;
+
+    // epsilon closure of the nfa states reachable on c
+    vector<int> target;
+    for (const int s : states[state].subset) {
+        for (const auto& [sym, d] : nfa.moves[s]) {
+            if (sym != c)
+                continue;
+            for (const int r : nfa.closure[d]) {
+                if (stamp[r] != stampId) {
+                    stamp[r] = stampId;
+                    target.push_back(r);
+                }
+            }
+        }
+    }
+    stampId++;
+
+    if (target.empty()) {
+        // no transition on c, remember the FAIL
+        states[state].next[k] = -1;
+        return -1;
+    }
+    sort(target.begin(), target.end());
+
+    const size_t flushesBefore = flushes;
+    const int next = StateOf(std::move(target));
+    // a flush dropped the source state, so there is nothing to record the move in
+    if (flushes == flushesBefore)
+        states[state].next[k] = next;
+    return next;
+}
+
+//---------------------------------------------------------------------------------
+// look up a subset in the cache, adding it (and flushing first if the
+// cache is over budget) when it is new
+//---------------------------------------------------------------------------------
+int LazyDFA::StateOf(vector<int>&& subset) {
+    if (const auto it = subsetToState.find(subset); it != subsetToState.end())
+        return it->second;
+
+    // rough footprint: the state itself, its moves, its subset twice (state and index key), and the index node
+    const size_t bytes = sizeof(State) + (nfa.numClasses + 2 * subset.size()) * sizeof(int) + 64;
+    // always keep at least the start state and the one being added
+    if (usedBytes + bytes > cacheBytes && states.size() > 1) {
+        Flush();
+        if (const auto it = subsetToState.find(subset); it != subsetToState.end())
+            return it->second;
+    }
+
+    int token = -1;
+    for (const int s : subset) {
+        if (nfa.finalToken[s] >= 0 && (token < 0 || nfa.finalToken[s] < token))
+            token = nfa.finalToken[s];
+    }
+    const int id = static_cast<int>(states.size());
+    states.push_back({subset, token, vector<int>(nfa.numClasses, UNKNOWN)});
+    subsetToState.emplace(std::move(subset), id);
+    usedBytes += bytes;
+    return id;
+}
+
+//---------------------------------------------------------------------------------
+// drop every cached state except the start state
+//---------------------------------------------------------------------------------
+void LazyDFA::Flush() {
+    flushes++;
+    states.clear();
+    subsetToState.clear();
+    usedBytes = 0;
+    StateOf(vector<int>(nfa.closure[nfa.init_state]));
+}
@@ -0,0 +1,56 @@
+#ifndef LAZYDFA_H
+#define LAZYDFA_H
+
+#include <unordered_map>
+#include <vector>
+#include "NFA.h"
+
+//---------------------------------------------------------------------------------
+// class LazyDFA
+// determinizes an NFA on demand: a DFA state (a subset of NFA states) is only
+// built when the input first reaches it, and its moves are filled in as they are
+// taken. built states live in a cache with a memory budget; when the budget is
+// exceeded the whole cache is flushed and rebuilt from the start state.
+// state ids are only valid until the next call to Next that flushes the cache.
+// the flattened NFA is only read, so many caches can share one; a cache
+// itself belongs to a single scanner
+//---------------------------------------------------------------------------------
+class LazyDFA {
+public:
+    LazyDFA(const FlatNFA& nfa, size_t cacheBytes);
+
+    int GetStartState() const { return 0; }
+    int Next(int state, char c);
+    bool IsAccepting(int state) const { return states[state].token >= 0; }
+    int GetAcceptToken(int state) const { return states[state].token; }
+    bool AcceptsEmpty() const { return IsAccepting(GetStartState()); }
+
+    int NumStates() const { return static_cast<int>(states.size()); }
+    size_t GetFlushCount() const { return flushes; }
+
+private:
+    static constexpr int UNKNOWN = -2; // move not computed yet (-1 is FAIL, as in DFA)
+
+    struct State {
+        std::vector<int> subset;      // sorted nfa states
+        int token;                    // accepted token, -1 if not final
+        std::vector<int> next;        // cached moves, one per byte class
+    };
+
+    int StateOf(std::vector<int>&& subset);
+    void Flush();
+
+    const FlatNFA& nfa;
+
+    // state cache
+    std::vector<State> states;
+    std::unordered_map<std::vector<int>, int, SubsetHash> subsetToState;
+    size_t cacheBytes;   // memory budget for the cache
+    size_t usedBytes = 0;
+    size_t flushes = 0;
+
+    std::vector<int> stamp; // scratch for deduplicating subsets
+    int stampId = 0;
+};
+
+#endif
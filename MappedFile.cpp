@@ -0,0 +1,36 @@
+#include "MappedFile.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+//---------------------------------------------------------------------------------
+// MappedFile ctor: map the file read-only; IsOpen() reports failure
+//---------------------------------------------------------------------------------
+MappedFile::MappedFile(const string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    struct stat st {};
+    if (fstat(fd, &st) == 0) {
+        const size_t length = static_cast<size_t>(st.st_size);
+        if (length == 0) {
+            // mmap rejects empty mappings, an empty file is just empty text
+            opened = true;
+        } else if (void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0); mapped != MAP_FAILED) {
+            data = static_cast<const char*>(mapped);
+            size = length;
+            opened = true;
+            // the input is scanned front to back
+            madvise(mapped, length, MADV_SEQUENTIAL);
+        }
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data)
+        munmap(const_cast<char*>(data), size);
+}
@@ -0,0 +1,27 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <string_view>
+
+//---------------------------------------------------------------------------------
+// class MappedFile
+// a read-only memory mapping of a whole file, so its bytes can be lexed in place
+//---------------------------------------------------------------------------------
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool IsOpen() const { return opened; }
+    std::string_view GetText() const { return {data, size}; }
+
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+    bool opened = false;
+};
+
+#endif
@@ -3,12 +3,18 @@
 #include <set>
 #include <map>
 #include <stack>
-#include <queue>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <tuple>
 
 using namespace std;
 
 void NFA::AddTransition(const int src, const set<int>& dst, const char sym) {
-    // just add new destination states to what we already have
+    // grow the state arena if needed, then add new destination states to what we already have
+    if (src >= static_cast<int>(Ntran.size())) {
+        Ntran.resize(src + 1);
+    }
     Ntran[src][sym].insert(dst.begin(), dst.end());
     if (src > max_node_label) {
         max_node_label = src;
@@ -20,13 +26,37 @@ void NFA::AddTransition(const int src, const set<int>& dst, const char sym) {
     }
 }
 
+//----------------------------------------------------------------------
+// copy the other nfa's transitions into this one, bumping each of its
+// states past our largest label; returns the offset that was applied
+//----------------------------------------------------------------------
+int NFA::CopyShifted(const NFA& other) {
+    const int offset = max_node_label + 1;
+    for (size_t other_src = 0; other_src < other.Ntran.size(); other_src++) {
+        const int src = static_cast<int>(other_src) + offset;
+        for (const auto& sym_entry : other.Ntran[other_src]) {
+            const char sym = sym_entry.first;
+            set<int> renamed_dst;
+            for (const int s : sym_entry.second) {
+                renamed_dst.insert(s + offset);
+            }
+            AddTransition(src, renamed_dst, sym);
+        }
+    }
+    // make sure states without outgoing transitions are accounted for too
+    if (other.max_node_label + offset > max_node_label) {
+        max_node_label = other.max_node_label + offset;
+    }
+    return offset;
+}
+
 void NFA::Union(const NFA& other) {
     // make new init and final states for union
     const int new_initial = CreateNewState(); // new_initial is left_max+1
     int new_final = CreateNewState(); // new_final is left_max+2
 
-    // calculate offset for the other nfa since we already added two new states
-    const int offset = max_node_label + 1; // offset becomes left_max+3
+    // copy over the other nfa after the two new states, so offset becomes left_max+3
+    const int offset = CopyShifted(other);
 
     // add epsilon transitions from new init state to both the old init and shifted other nfa's init
     AddTransition(new_initial, {init_state}, epsilon);
@@ -41,20 +71,6 @@ void NFA::Union(const NFA& other) {
         AddTransition(f + offset, {new_final}, epsilon);
     }
 
-    // copy over transitions from the other nfa, bumping each state by the offset
-    for (const auto& src_entry : other.Ntran) {
-        const int src = src_entry.first + offset;
-        for (const auto& sym_entry : src_entry.second) {
-            const char sym = sym_entry.first;
-            set<int> dst = sym_entry.second;
-            set<int> renamed_dst;
-            for (const int s : dst) {
-                renamed_dst.insert(s + offset);
-            }
-            AddTransition(src, renamed_dst, sym);
-        }
-    }
-
     // update init and final states to the new ones
     init_state = new_initial;
     fin_states.clear();
@@ -65,21 +81,7 @@ void NFA::Union(const NFA& other) {
 }
 
 void NFA::Concat(const NFA& other) {
-    const int original_max = max_node_label;
-    const int offset = original_max + 1;
-
-    for (const auto& src_entry : other.Ntran) {
-        const int src = src_entry.first + offset;
-        for (const auto& sym_entry : src_entry.second) {
-            const char sym = sym_entry.first;
-            set<int> dst = sym_entry.second;
-            set<int> renamed_dst;
-            for (const int s : dst) {
-                renamed_dst.insert(s + offset);
-            }
-            AddTransition(src, renamed_dst, sym);
-        }
-    }
+    const int offset = CopyShifted(other);
 
     for (const int f : fin_states) {
         AddTransition(f, {other.init_state + offset}, epsilon);
@@ -110,6 +112,138 @@ void NFA::Kleene() {
     fin_states.insert(new_final);
 }
 
+//----------------------------------------------------------------------
+// mark every final state as accepting the given token; lower tokens win
+// when a dfa state contains finals of several tokens
+//----------------------------------------------------------------------
+void NFA::TagFinalStates(const int token) {
+    for (const int f : fin_states) {
+        fin_tokens[f] = token;
+    }
+}
+
+int NFA::TokenOf(const int fstate) const {
+    const auto it = fin_tokens.find(fstate);
+    return it == fin_tokens.end() ? 0 : it->second;
+}
+
+//----------------------------------------------------------------------
+// add the other nfa as one more alternative from our initial state.
+// unlike union, the final states (and their tokens) of both sides are
+// kept, so a lexer can tell which definition matched
+//----------------------------------------------------------------------
+void NFA::AddAlternative(const NFA& other) {
+    const int offset = CopyShifted(other);
+    AddTransition(init_state, {other.init_state + offset}, epsilon);
+    for (const int f : other.fin_states) {
+        fin_states.insert(f + offset);
+        fin_tokens[f + offset] = other.TokenOf(f);
+    }
+    alphabet.insert(other.alphabet.begin(), other.alphabet.end());
+}
+
+// every (source, symbol, target) edge, epsilon moves included
+size_t NFA::NumTransitions() const {
+    size_t count = 0;
+    for (const auto& row : Ntran) {
+        for (const auto& [sym, dsts] : row)
+            count += dsts.size();
+    }
+    return count;
+}
+
+// the state vector plus one tree node per (state, symbol) and per target;
+// a std::map/std::set node carries three pointers and a color besides its value
+size_t NFA::NtranBytes() const {
+    constexpr size_t node = 4 * sizeof(void*);
+    size_t bytes = Ntran.capacity() * sizeof(Ntran[0]);
+    for (const auto& row : Ntran) {
+        for (const auto& [sym, dsts] : row)
+            bytes += node + sizeof(pair<const char, set<int>>) + dsts.size() * (node + sizeof(int));
+    }
+    return bytes;
+}
+
+//----------------------------------------------------------------------
+// check if the nfa accepts the empty string
+//----------------------------------------------------------------------
+bool NFA::AcceptsEmpty() {
+    for (const int s : EpsilonClosure({init_state})) {
+        if (fin_states.find(s) != fin_states.end())
+            return true;
+    }
+    return false;
+}
+
+//----------------------------------------------------------------------
+// Thompson construction on fragments: each operation adds a constant
+// number of states and epsilon edges to this nfa, leaving the operands'
+// states in place instead of copying and renumbering them
+//----------------------------------------------------------------------
+NFAFragment NFA::SymbolFragment(const char c) {
+    const int s0 = CreateNewState();
+    const int s1 = CreateNewState();
+    AddTransition(s0, {s1}, c);
+    AddSymbol(c);
+    return {s0, s1};
+}
+
+//----------------------------------------------------------------------
+// a class operand: each byte sequence is a chain of range edges from one
+// start to one final state. chains are built back to front and a state is
+// reused whenever its (range, next state) was already built, so sequences
+// that end alike share their tails, e.g. every [80-BF] into the final state
+//----------------------------------------------------------------------
+NFAFragment NFA::ClassFragment(const vector<ByteSequence>& sequences) {
+    const int s0 = CreateNewState();
+    const int s1 = CreateNewState();
+    map<tuple<unsigned char, unsigned char, int>, int> suffixes;
+    for (const ByteSequence& sequence : sequences) {
+        int next = s1;
+        for (size_t i = sequence.size() - 1; i > 0; i--) {
+            const auto key = make_tuple(sequence[i].low, sequence[i].high, next);
+            auto it = suffixes.find(key);
+            if (it == suffixes.end()) {
+                const int s = CreateNewState();
+                AddRange(s, next, sequence[i]);
+                it = suffixes.emplace(key, s).first;
+            }
+            next = it->second;
+        }
+        AddRange(s0, next, sequence[0]);
+    }
+    return {s0, s1};
+}
+
+void NFA::AddRange(const int src, const int dst, const ByteRange range) {
+    for (int b = range.low; b <= range.high; b++) {
+        AddTransition(src, {dst}, static_cast<char>(b));
+        AddSymbol(static_cast<char>(b));
+    }
+}
+
+NFAFragment NFA::UnionFragments(const NFAFragment a, const NFAFragment b) {
+    const int new_initial = CreateNewState();
+    const int new_final = CreateNewState();
+    AddTransition(new_initial, {a.start, b.start}, epsilon);
+    AddTransition(a.final, {new_final}, epsilon);
+    AddTransition(b.final, {new_final}, epsilon);
+    return {new_initial, new_final};
+}
+
+NFAFragment NFA::ConcatFragments(const NFAFragment a, const NFAFragment b) {
+    AddTransition(a.final, {b.start}, epsilon);
+    return {a.start, b.final};
+}
+
+NFAFragment NFA::KleeneFragment(const NFAFragment a) {
+    const int new_initial = CreateNewState();
+    const int new_final = CreateNewState();
+    AddTransition(new_initial, {a.start, new_final}, epsilon);
+    AddTransition(a.final, {a.start, new_final}, epsilon);
+    return {new_initial, new_final};
+}
+
 void NFA::Print() const {
     cout << "Initial state: " << init_state << endl;
     cout << "Final states: ";
@@ -118,9 +252,8 @@ void NFA::Print() const {
     }
     cout << endl;
     cout << "Transitions:" << endl;
-    for (const auto& src_entry : Ntran) {
-        const int src = src_entry.first;
-        for (const auto& sym_entry : src_entry.second) {
+    for (size_t src = 0; src < Ntran.size(); src++) {
+        for (const auto& sym_entry : Ntran[src]) {
             char sym = sym_entry.first;
             const set<int>& dst = sym_entry.second;
             cout << src << " --" << sym << "--> ";
@@ -150,7 +283,7 @@ set<int> NFA::EpsilonClosure(const set<int>& states) {
         stateStack.pop();
 
         // check if state s has any epsilon transitions
-        if (Ntran.find(s) != Ntran.end()) {
+        if (s < static_cast<int>(Ntran.size())) {
             auto it = Ntran[s].find(epsilon);
             if (it != Ntran[s].end()) {
                 // for each state reachable with an epsilon transition
@@ -168,77 +301,157 @@ set<int> NFA::EpsilonClosure(const set<int>& states) {
     return closure;
 }
 
+//----------------------------------------------------------------------
+// flatten Ntran for simulation: the non-epsilon moves of every state,
+// the epsilon closure of every single state as a sorted vector, the
+// token of every final state, and the byte equivalence classes
+//----------------------------------------------------------------------
+FlatNFA NFA::Flatten() const {
+    const int n = max_node_label + 1;
+    FlatNFA flat;
+    auto& moves = flat.moves;
+    auto& closure = flat.closure;
+    moves.assign(n, {});
+    closure.assign(n, {});
+    flat.init_state = init_state;
+    flat.finalToken.assign(n, -1);
+    for (const int f : fin_states)
+        flat.finalToken[f] = TokenOf(f);
+    for (size_t src = 0; src < Ntran.size(); src++) {
+        for (const auto& [sym, dsts] : Ntran[src]) {
+            if (sym == epsilon)
+                continue;
+            for (const int d : dsts)
+                moves[src].emplace_back(sym, d);
+        }
+    }
+    vector<int> stamp(n, -1); // stamp[s] == k means s is already in the closure of state k
+    for (int s = 0; s < n; s++) {
+        vector<int>& cl = closure[s];
+        cl.push_back(s);
+        stamp[s] = s;
+        for (size_t i = 0; i < cl.size(); i++) {
+            if (cl[i] >= static_cast<int>(Ntran.size()))
+                continue;
+            const auto eps = Ntran[cl[i]].find(epsilon);
+            if (eps == Ntran[cl[i]].end())
+                continue;
+            for (const int next : eps->second) {
+                if (stamp[next] != s) {
+                    stamp[next] = s;
+                    cl.push_back(next);
+                }
+            }
+        }
+        sort(cl.begin(), cl.end());
+    }
+
+    // bytes with the same (source, target) moves belong to one class
+    vector<vector<pair<int, int>>> movesOn(256);
+    for (int src = 0; src < n; src++) {
+        for (const auto& [sym, d] : moves[src])
+            movesOn[static_cast<unsigned char>(sym)].emplace_back(src, d);
+    }
+    map<vector<pair<int, int>>, int> classOf;
+    for (int b = 0; b < 256; b++) {
+        const auto it = classOf.emplace(movesOn[b], static_cast<int>(classOf.size())).first;
+        flat.byteClass[b] = static_cast<unsigned char>(it->second);
+    }
+    flat.numClasses = static_cast<int>(classOf.size());
+    return flat;
+}
+
 //----------------------------------------------------------------------
 // nfa2dfa: convert this nfa into an equivalent dfa using the subset
-// construction algorithm
+// construction algorithm. nfa states are numbered densely, so subsets
+// are kept as sorted vectors keyed in a hash table, and the epsilon
+// closure of every single state is computed once up front
 //----------------------------------------------------------------------
 DFA NFA::NFA2DFA() {
-    // map each subset of nfa states to a unique dfa state (integer)
-    map<set<int>, int> subsetToDFA;
-    int nextDFAState = 0;
-    queue<set<int>> unprocessed;
+    const int n = max_node_label + 1;
 
-    // the initial dfa state is the epsilon-closure of the nfa's init state
-    set<int> startSubset = EpsilonClosure({init_state});
-    subsetToDFA[startSubset] = nextDFAState++;
-    unprocessed.push(startSubset);
+    // flatten Ntran: non-epsilon moves per state, and each state's epsilon closure
+    const FlatNFA flat = Flatten();
+    const auto& moves = flat.moves;
+    const auto& closure = flat.closure;
+    const auto& finalToken = flat.finalToken;
+    vector<int> stamp(n, -1); // stamp[s] == k means s is already in the k-th set being built
+    int stampId = 0;
+
+    // map each subset of nfa states to a unique dfa state (integer)
+    unordered_map<vector<int>, int, SubsetHash> subsetToDFA;
+    vector<const vector<int>*> dfaSubsets; // subset of each dfa state, in creation order
 
-    // figure out which dfa states are final
+    // figure out which dfa states are final, and which token each one accepts
     set<int> DFAfinalStates;
-    // if any nfa state in the start subset is final, mark dfa state 0 as final
-    for (int s : startSubset) {
-        if (fin_states.find(s) != fin_states.end()) {
-            DFAfinalStates.insert(subsetToDFA[startSubset]);
-            break;
+    map<int, int> DFAfinalTokens;
+    // a dfa state is final if any of its nfa states is; it accepts the lowest token among them
+    auto markFinal = [&](const vector<int>& subset, const int dfaState) {
+        for (int s : subset) {
+            if (finalToken[s] >= 0) {
+                const int token = finalToken[s];
+                if (DFAfinalStates.insert(dfaState).second || token < DFAfinalTokens[dfaState])
+                    DFAfinalTokens[dfaState] = token;
+            }
         }
-    }
+    };
+    // look up a subset, numbering it as a new dfa state if it hasn't been seen
+    auto stateOf = [&](vector<int>&& subset) {
+        const auto [it, inserted] = subsetToDFA.emplace(std::move(subset), static_cast<int>(dfaSubsets.size()));
+        if (inserted) {
+            dfaSubsets.push_back(&it->first);
+            markFinal(it->first, it->second);
+        }
+        return it->second;
+    };
+
+    // the initial dfa state is the epsilon-closure of the nfa's init state
+    stateOf(vector<int>(closure[init_state]));
 
     // temporary structure for dfa transitions, not that it matters
     map<int, map<char, int>> dfaTransitions;
 
-    // for each unprocessed dfa state (which is a subset of nfa states)
-    while (!unprocessed.empty()) {
-        set<int> currentSubset = unprocessed.front();
-        unprocessed.pop();
-        int currentDFAState = subsetToDFA[currentSubset];
-
-        // for each symbol in the nfa's alphabet (skip epsilon)
-        for (char sym : alphabet) {
-            if (sym == epsilon)
-                continue;
-
-            // compute the set of states reachable on symbol sym
-            set<int> moveSet;
-            for (int s : currentSubset) {
-                if (Ntran.find(s) != Ntran.end()) {
-                    if (auto it = Ntran[s].find(sym); it != Ntran[s].end()) {
-                        moveSet.insert(it->second.begin(), it->second.end());
-                    }
+    // per-symbol target sets for the subset being processed; symbols are
+    // visited in alphabet order so dfa numbering matches a plain bfs
+    vector<vector<int>> targets(256);
+    vector<int> targetStamp(256, -1);
+    vector<char> symbols;
+
+    // process dfa states in creation order (breadth first)
+    for (size_t current = 0; current < dfaSubsets.size(); current++) {
+        const vector<int>& currentSubset = *dfaSubsets[current];
+
+        // collect the nfa states reachable on each symbol
+        symbols.clear();
+        for (const int s : currentSubset) {
+            for (const auto& [sym, d] : moves[s]) {
+                const int slot = static_cast<unsigned char>(sym);
+                if (targetStamp[slot] != static_cast<int>(current)) {
+                    targetStamp[slot] = static_cast<int>(current);
+                    targets[slot].clear();
+                    symbols.push_back(sym);
                 }
+                targets[slot].push_back(d);
             }
+        }
+        sort(symbols.begin(), symbols.end());
+
+        for (const char sym : symbols) {
             // take the epsilon closure of the reached states
-            set<int> nextSubset = EpsilonClosure(moveSet);
-
-            if (nextSubset.empty())
-                continue; // no transition on this symbol, so skip
-
-            // if this subset is new, assign it a new dfa state, whatevs
-            if (subsetToDFA.find(nextSubset) == subsetToDFA.end()) {
-                subsetToDFA[nextSubset] = nextDFAState;
-                // check if any state in nextsubset is final in the nfa
-                for (int s : nextSubset) {
-                    if (fin_states.find(s) != fin_states.end()) {
-                        DFAfinalStates.insert(nextDFAState);
-                        break;
+            vector<int> nextSubset;
+            for (const int d : targets[static_cast<unsigned char>(sym)]) {
+                for (const int c : closure[d]) {
+                    if (stamp[c] != stampId) {
+                        stamp[c] = stampId;
+                        nextSubset.push_back(c);
                     }
                 }
-                unprocessed.push(nextSubset);
-                nextDFAState++;
             }
+            stampId++;
+            sort(nextSubset.begin(), nextSubset.end());
 
-            // add the dfa transition
-            int nextDFAStateID = subsetToDFA[nextSubset];
-            dfaTransitions[currentDFAState][sym] = nextDFAStateID;
+            // add the dfa transition, creating the target state if it is new
+            dfaTransitions[static_cast<int>(current)][sym] = stateOf(std::move(nextSubset));
         }
     }
 
@@ -251,6 +464,9 @@ DFA NFA::NFA2DFA() {
     // the initial dfa state is 0
     set<int> dfaInitial = {0};
     DFA dfa(dfaAlphabet, dfaInitial, DFAfinalStates);
+    for (const auto& [state, token] : DFAfinalTokens) {
+        dfa.SetAcceptToken(state, token);
+    }
 
     // add transitions to the dfa
     for (const auto& row : dfaTransitions) {
@@ -261,6 +477,8 @@ DFA NFA::NFA2DFA() {
             dfa.AddTransition(src, dst, sym);
         }
     }
+    // flatten the transitions into the dense table used for scanning
+    dfa.Compile();
 
     return dfa;
-}
\ No newline at end of file
+}
@@ -7,7 +7,47 @@
 //---------------------------------------------------------------------------------
 #include <set>
 #include <map>
+#include <vector>
 #include "DFA.h"
+#include "Utf8.h"
+
+//---------------------------------------------------------------------------------
+// a Thompson fragment inside an NFA used as a node arena: its entry state and
+// its single exit state. combining fragments only adds a few states and edges
+//---------------------------------------------------------------------------------
+struct NFAFragment {
+    int start;
+    int final;
+};
+
+//---------------------------------------------------------------------------------
+// hash for a sorted subset of nfa states (FNV-1a over the state numbers)
+//---------------------------------------------------------------------------------
+struct SubsetHash {
+    size_t operator()(const std::vector<int>& subset) const {
+        size_t h = 14695981039346656037ull;
+        for (const int s : subset) {
+            h ^= static_cast<size_t>(s);
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+};
+
+//---------------------------------------------------------------------------------
+// an NFA flattened for simulation: the non-epsilon moves of every state, the
+// epsilon closure of every single state (sorted), the token accepted by every
+// state (-1 if not final), and the byte equivalence classes (bytes every state
+// moves on identically). immutable once built
+//---------------------------------------------------------------------------------
+struct FlatNFA {
+    std::vector<std::vector<std::pair<char, int>>> moves;
+    std::vector<std::vector<int>> closure;
+    std::vector<int> finalToken;
+    int init_state = 0;
+    std::vector<unsigned char> byteClass = std::vector<unsigned char>(256, 0);
+    int numClasses = 1;
+};
 
 class NFA {
 public:
@@ -15,22 +55,40 @@ public:
     NFA(std::set<char> A, int I, std::set<int> F) : alphabet(A), init_state(I), fin_states(F), max_node_label(-1) {}
     void SetInitialState(int istate) { init_state = istate; if (istate > max_node_label) max_node_label = istate; }
     void SetFinalState(int fstate) { fin_states.clear(); fin_states.insert(fstate); if (fstate > max_node_label) max_node_label = fstate; }
+    void AddFinalState(int fstate) { fin_states.insert(fstate); if (fstate > max_node_label) max_node_label = fstate; }
     int GetMaxLabel() { return max_node_label; }
+    int GetInitialState() const { return init_state; }
     int CreateNewState() { max_node_label++; return max_node_label; }
     void AddTransition(int src, const std::set<int>& dst, char sym);
     void AddSymbol(char c) { alphabet.insert(c); }
     void Union(const NFA& other);
     void Concat(const NFA& other);
     void Kleene();
+    NFAFragment SymbolFragment(char c);
+    NFAFragment ClassFragment(const std::vector<ByteSequence>& sequences);
+    NFAFragment UnionFragments(NFAFragment a, NFAFragment b);
+    NFAFragment ConcatFragments(NFAFragment a, NFAFragment b);
+    NFAFragment KleeneFragment(NFAFragment a);
+    void TagFinalStates(int token);
+    void AddAlternative(const NFA& other);
+    bool AcceptsEmpty();
     std::set<int> EpsilonClosure(const std::set<int>& states);
+    FlatNFA Flatten() const;
     DFA NFA2DFA();
     void Print() const;
+    size_t NumTransitions() const;
+    size_t NtranBytes() const; // approximate heap footprint of Ntran
 private:
-    std::map<int, std::map<char, std::set<int>>> Ntran;
+    int CopyShifted(const NFA& other);
+    void AddRange(int src, int dst, ByteRange range);
+    int TokenOf(int fstate) const;
+
+    std::vector<std::map<char, std::set<int>>> Ntran; // indexed by state
     std::set<char> alphabet;
     char epsilon = '_';
     int init_state;
     std::set<int> fin_states;
+    std::map<int, int> fin_tokens; // token (priority) of each tagged final state, untagged finals are token 0
     int max_node_label;
 };
 
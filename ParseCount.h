@@ -0,0 +1,28 @@
+#ifndef PARSECOUNT_H
+#define PARSECOUNT_H
+
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <limits>
+
+//---------------------------------------------------------------------------------
+// the value of a count option: decimal digits that fit in T. stoul and stoi
+// would also take "-1" or "8MB", or throw on "x"; a caller reports false as a
+// bad value
+//---------------------------------------------------------------------------------
+template <class T>
+bool ParseCount(const char* text, T& value) {
+    if (!std::isdigit(static_cast<unsigned char>(*text)))
+        return false;
+    char* end;
+    errno = 0;
+    const unsigned long long parsed = std::strtoull(text, &end, 10);
+    if (*end != '\0' || errno == ERANGE
+        || parsed > static_cast<unsigned long long>(std::numeric_limits<T>::max()))
+        return false;
+    value = static_cast<T>(parsed);
+    return true;
+}
+
+#endif
@@ -0,0 +1,152 @@
+#include "ScannerGenerator.h"
+#include <cctype>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+using namespace std;
+
+//---------------------------------------------------------------------------------
+// a C++ identifier from the file name part of prefix
+//---------------------------------------------------------------------------------
+static string NamespaceName(const string& prefix) {
+    const size_t slash = prefix.find_last_of("/\\");
+    string name = prefix.substr(slash == string::npos ? 0 : slash + 1);
+    for (char& c : name) {
+        if (!isalnum(static_cast<unsigned char>(c)))
+            c = '_';
+    }
+    if (name.empty() || isdigit(static_cast<unsigned char>(name[0])))
+        name = "scanner_" + name;
+    return name;
+}
+
+static string QuoteString(const string& s) {
+    string quoted = "\"";
+    for (const char c : s) {
+        if (c == '"' || c == '\\')
+            quoted += '\\';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+static string CaseLabel(const int byte) {
+    if (isalnum(byte))
+        return string("'") + static_cast<char>(byte) + "'";
+    return to_string(byte);
+}
+
+bool GenerateScanner(const LexerSpec& spec, const string& prefix, string& error) {
+    if (spec.IsLazy() || !spec.GetBitRules().empty()) {
+        error = "a lazy or bit-parallel spec has no DFA to generate a scanner from";
+        return false;
+    }
+    const DFA& dfa = spec.GetDFA();
+    const string ns = NamespaceName(prefix);
+    const size_t slash = prefix.find_last_of("/\\");
+    const string headerName = prefix.substr(slash == string::npos ? 0 : slash + 1) + ".h";
+
+    //---- header: token table and the Match entry point
+    ostringstream h;
+    h << "// generated by CSE_340_Project_1 --generate, do not edit\n"
+      << "#ifndef " << ns << "_H\n"
+      << "#define " << ns << "_H\n\n"
+      << "#include <cstddef>\n\n"
+      << "namespace " << ns << " {\n\n"
+      << "constexpr int TOKEN_COUNT = " << spec.NumTokens() << ";\n"
+      << "extern const char* const tokenNames[TOKEN_COUNT > 0 ? TOKEN_COUNT : 1];\n\n"
+      << "// length of the longest token at [p, end), 0 if none; token is set to its\n"
+      << "// definition index (earliest definition on ties)\n"
+      << "std::size_t Match(const char* p, const char* end, int& token);\n\n"
+      << "} // namespace " << ns << "\n\n"
+      << "#endif\n";
+
+    //---- source: one label per state
+    ostringstream c;
+    c << "// generated by CSE_340_Project_1 --generate, do not edit\n"
+      << "#include \"" << headerName << "\"\n\n"
+      << "namespace " << ns << " {\n\n"
+      << "const char* const tokenNames[TOKEN_COUNT > 0 ? TOKEN_COUNT : 1] = {";
+    for (int t = 0; t < spec.NumTokens(); t++)
+        c << (t ? ", " : "") << QuoteString(spec.GetTokenName(t));
+    if (spec.NumTokens() == 0)
+        c << "nullptr";
+    c << "};\n\n"
+      << "std::size_t Match(const char* p, const char* const end, int& token) {\n"
+      << "    const char* const begin = p;\n"
+      << "    std::size_t length = 0;\n"
+      << "    token = -1;\n"
+      << "    goto s" << dfa.GetStartState() << ";\n";
+    for (int s = 0; s < dfa.NumStates(); s++) {
+        c << "s" << s << ":\n";
+        if (dfa.IsAccepting(s)) {
+            c << "    length = static_cast<std::size_t>(p - begin);\n"
+              << "    token = " << dfa.GetAcceptToken(s) << ";\n";
+        }
+        // group the bytes by target state, so each target is one run of case labels
+        map<int, vector<int>> bytesTo;
+        for (int b = 0; b < 256; b++) {
+            if (const int t = dfa.Next(s, static_cast<char>(b)); t >= 0)
+                bytesTo[t].push_back(b);
+        }
+        if (bytesTo.empty()) {
+            c << "    return length;\n";
+            continue;
+        }
+        c << "    if (p == end)\n"
+          << "        return length;\n"
+          << "    switch (static_cast<unsigned char>(*p++)) {\n";
+        for (const auto& [target, bytes] : bytesTo) {
+            c << "    ";
+            for (const int b : bytes)
+                c << "case " << CaseLabel(b) << ": ";
+            c << "goto s" << target << ";\n";
+        }
+        c << "    default: return length;\n"
+          << "    }\n";
+    }
+    c << "}\n\n"
+      << "} // namespace " << ns << "\n\n"
+      << "#ifdef GENERATED_SCANNER_MAIN\n"
+      << "#include <cctype>\n"
+      << "#include <iostream>\n"
+      << "#include <string>\n\n"
+      << "// lex one quoted input line from stdin, printing tokens like the lexer does\n"
+      << "int main() {\n"
+      << "    std::string input;\n"
+      << "    std::getline(std::cin, input);\n"
+      << "    if (input.size() >= 2 && input.front() == '\"' && input.back() == '\"')\n"
+      << "        input = input.substr(1, input.size() - 2);\n"
+      << "    const char* p = input.data();\n"
+      << "    const char* const end = p + input.size();\n"
+      << "    while (true) {\n"
+      << "        while (p < end && std::isspace(static_cast<unsigned char>(*p)))\n"
+      << "            p++;\n"
+      << "        if (p == end)\n"
+      << "            break;\n"
+      << "        int token;\n"
+      << "        const std::size_t length = " << ns << "::Match(p, end, token);\n"
+      << "        if (length == 0) {\n"
+      << "            std::cout << \"INVALID , \\\"\" << *p++ << \"\\\"\\n\";\n"
+      << "            continue;\n"
+      << "        }\n"
+      << "        std::cout << " << ns << "::tokenNames[token] << \" , \\\"\";\n"
+      << "        std::cout.write(p, static_cast<std::streamsize>(length)) << \"\\\"\\n\";\n"
+      << "        p += length;\n"
+      << "    }\n"
+      << "    return 0;\n"
+      << "}\n"
+      << "#endif\n";
+
+    ofstream header(prefix + ".h");
+    header << h.str();
+    ofstream source(prefix + ".cpp");
+    source << c.str();
+    if (!header || !source) {
+        error = "cannot write " + prefix + ".h / " + prefix + ".cpp";
+        return false;
+    }
+    return true;
+}
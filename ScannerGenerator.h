@@ -0,0 +1,16 @@
+#ifndef SCANNERGENERATOR_H
+#define SCANNERGENERATOR_H
+
+#include <string>
+#include "lexer.h"
+
+//---------------------------------------------------------------------------------
+// write a direct-coded scanner for a compiled spec as prefix.h / prefix.cpp:
+// every DFA state becomes a label with a switch over the next byte, so the
+// generated Match walks the automaton with jumps instead of table lookups.
+// prefix.cpp also holds a main (under GENERATED_SCANNER_MAIN) that lexes a
+// quoted input line like the lexer itself does
+//---------------------------------------------------------------------------------
+bool GenerateScanner(const LexerSpec& spec, const std::string& prefix, std::string& error);
+
+#endif
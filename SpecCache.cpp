@@ -0,0 +1,24 @@
+#include "SpecCache.h"
+
+using namespace std;
+
+//---------------------------------------------------------------------------------
+// the compiled spec for a definition line, compiling it on a miss
+//---------------------------------------------------------------------------------
+shared_ptr<const LexerSpec> SpecCache::Get(const string& tokenDefs) {
+    string key = LexerSpec::Normalize(tokenDefs);
+    if (const auto found = index.find(key); found != index.end()) {
+        hits++;
+        entries.splice(entries.begin(), entries, found->second);
+        return found->second->second;
+    }
+
+    misses++;
+    entries.emplace_front(std::move(key), make_shared<const LexerSpec>(tokenDefs, options));
+    index.emplace(entries.front().first, entries.begin());
+    if (entries.size() > capacity) {
+        index.erase(entries.back().first);
+        entries.pop_back();
+    }
+    return entries.front().second;
+}
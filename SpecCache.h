@@ -0,0 +1,40 @@
+#ifndef SPECCACHE_H
+#define SPECCACHE_H
+
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "lexer.h"
+
+//---------------------------------------------------------------------------------
+// class SpecCache
+// compiled specs keyed by their normalized definition line (see
+// LexerSpec::Normalize), dropping the least recently used one once more than
+// `capacity` are held. specs are shared, so an evicted one stays alive for
+// lexers still using it
+//---------------------------------------------------------------------------------
+class SpecCache {
+public:
+    SpecCache(size_t capacity, const LexerOptions& options) : capacity(std::max<size_t>(capacity, 1)), options(options) {}
+
+    std::shared_ptr<const LexerSpec> Get(const std::string& tokenDefs);
+
+    size_t GetHits() const { return hits; }
+    size_t GetMisses() const { return misses; }
+    size_t Size() const { return entries.size(); }
+
+private:
+    using Entry = std::pair<std::string, std::shared_ptr<const LexerSpec>>;
+
+    std::list<Entry> entries; // most recently used first
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> index; // keys view the entries' strings
+    size_t capacity;
+    LexerOptions options;
+    size_t hits = 0;
+    size_t misses = 0;
+};
+
+#endif
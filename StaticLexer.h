@@ -0,0 +1,528 @@
+#ifndef STATICLEXER_H
+#define STATICLEXER_H
+
+//---------------------------------------------------------------------------------
+// StaticLexer<Spec>
+// a lexer for token definitions fixed at build time. the definitions line (the
+// same "t1 a|b , t2 a*.a , t3 (a|b)*.c*.c #" format the lexer reads) is compiled
+// while the program is compiled: shunting-yard, Glushkov's position automaton,
+// subset construction and minimization all run in constexpr functions over
+// fixed-capacity arrays, and only the finished transition table is stored in
+// the binary.
+// there is no startup cost, and since the table is a constant the compiler can
+// fold and inline lookups into it. header only, C++17:
+//
+//     static constexpr char spec[] = "IF i.f , ID (a|b|c)*.(a|b|c) #";
+//     StaticLexer<spec> lexer(input);
+//     for (auto token = lexer.Next(); token.id != static_lexer::EOS; token = lexer.Next())
+//
+// operands are ASCII letters only: classes and UTF-8 characters need the run
+// time lexer. a spec that uses them, defines no tokens, is malformed, accepts the
+// empty string or outgrows the limits below is a compile error
+//---------------------------------------------------------------------------------
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace static_lexer {
+
+constexpr std::size_t MaxRules = 64;
+constexpr std::size_t MaxPositions = 256; // symbol occurrences in all rules, plus the initial position
+constexpr std::size_t MaxStates = 256;    // DFA states, including the dead state
+constexpr std::size_t MaxClasses = 53;    // one per letter used, plus one for every other byte
+constexpr std::size_t MaxDepth = 128;     // operators and operands pending in one regex
+
+constexpr int EOS = -1;
+constexpr int INVALID = -2;
+
+// same fields as the runtime Token; every view stays valid as long as the input
+struct Token {
+    int id;               // definition index, or EOS / INVALID
+    std::string_view tokenName;
+    std::string_view lexeme;
+    std::size_t offset;   // position of the lexeme in the input
+};
+
+enum class Error { None, NoRules, Malformed, AcceptsEmpty, TooManyRules, TooManyPositions, TooManyStates, TooDeep, Utf8 };
+
+//---------------------------------------------------------------------------------
+// the index of the lowest set bit of a nonzero word, by de Bruijn multiplication:
+// the product's top 6 bits differ for each power of two. portable where
+// __builtin_ctzll is not, and still cheap in constant evaluation
+//---------------------------------------------------------------------------------
+constexpr std::uint64_t DeBruijn = 0x022fdd63cc95386dull;
+
+constexpr std::array<unsigned char, 64> LowestBitTable() {
+    std::array<unsigned char, 64> table{};
+    for (unsigned i = 0; i < 64; i++)
+        table[((std::uint64_t(1) << i) * DeBruijn) >> 58] = static_cast<unsigned char>(i);
+    return table;
+}
+
+constexpr std::array<unsigned char, 64> lowestBit = LowestBitTable();
+
+constexpr std::size_t LowestBit(const std::uint64_t bits) {
+    return lowestBit[((bits & (~bits + 1)) * DeBruijn) >> 58];
+}
+
+//---------------------------------------------------------------------------------
+// a set of positions
+//---------------------------------------------------------------------------------
+struct Positions {
+    static constexpr std::size_t Words = MaxPositions / 64;
+    std::uint64_t words[Words]{};
+
+    constexpr void Set(const std::size_t p) { words[p / 64] |= std::uint64_t(1) << (p % 64); }
+    constexpr bool Test(const std::size_t p) const { return (words[p / 64] >> (p % 64)) & 1; }
+    constexpr Positions& operator|=(const Positions& other) {
+        for (std::size_t w = 0; w < Words; w++)
+            words[w] |= other.words[w];
+        return *this;
+    }
+    constexpr Positions operator&(const Positions& other) const {
+        Positions result;
+        for (std::size_t w = 0; w < Words; w++)
+            result.words[w] = words[w] & other.words[w];
+        return result;
+    }
+    // f(p) for every position p in the set, in increasing order
+    template <class F>
+    constexpr void ForEach(F&& f) const {
+        for (std::size_t w = 0; w < Words; w++)
+            for (std::uint64_t bits = words[w]; bits != 0; bits &= bits - 1)
+                f(w * 64 + LowestBit(bits));
+    }
+    constexpr bool Empty() const {
+        for (const std::uint64_t w : words)
+            if (w != 0) return false;
+        return true;
+    }
+    constexpr bool operator==(const Positions& other) const {
+        for (std::size_t w = 0; w < Words; w++)
+            if (words[w] != other.words[w]) return false;
+        return true;
+    }
+    constexpr std::size_t Hash() const {
+        std::uint64_t h = 14695981039346656037ull;
+        for (const std::uint64_t w : words) {
+            h ^= w;
+            h *= 1099511628211ull;
+        }
+        return static_cast<std::size_t>(h ^ (h >> 32));
+    }
+};
+
+//---------------------------------------------------------------------------------
+// the compiled spec at full capacity: state 0 is dead and state 1 is the start.
+// StaticLexer keeps only the used part of it, so this one is never emitted
+//---------------------------------------------------------------------------------
+struct Table {
+    Error error = Error::None;
+    int numRules = 0;
+    std::array<std::size_t, MaxRules> nameBegin{};
+    std::array<std::size_t, MaxRules> nameLength{};
+    int numClasses = 1;
+    std::array<unsigned char, 256> byteClass{};
+    int numStates = 0;
+    std::array<unsigned char, MaxStates * MaxClasses> next{};
+    std::array<int, MaxStates> accept{};
+    int removedStates = 0; // merged away by Minimize
+};
+
+constexpr bool IsSpace(const char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+constexpr bool IsOperand(const char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+constexpr int Precedence(const char op) {
+    if (op == '*') return 3;
+    if (op == '.') return 2;
+    if (op == '|') return 1;
+    return 0;
+}
+
+//---------------------------------------------------------------------------------
+// Glushkov's position automaton of all rules together, position 0 being the
+// shared initial state. the regex is converted with shunting-yard as in
+// InfixToPostfix, but every symbol or operator it would append to the postfix
+// is applied to a stack of position sets right away, so no postfix is stored
+//---------------------------------------------------------------------------------
+struct PositionSets {
+    bool nullable = false;
+    Positions first;
+    Positions last;
+};
+
+struct Automaton {
+    Error error = Error::None;
+    std::size_t numPositions = 1;
+    std::array<char, MaxPositions> symbol{};
+    std::array<int, MaxPositions> rule{};
+    std::array<Positions, MaxPositions> follow{};
+    Positions finals;
+};
+
+class RegexBuilder {
+public:
+    constexpr RegexBuilder(Automaton& automaton) : a(automaton) {}
+
+    constexpr void Build(const std::string_view regex, const int rule) {
+        for (const char c : regex) {
+            if (IsOperand(c)) {
+                Output(c, rule);
+            } else if (c == '(' || c == '*') {
+                Push(c);
+            } else if (c == ')') {
+                while (numOps > 0 && ops[numOps - 1] != '(')
+                    Output(ops[--numOps], rule);
+                if (numOps == 0) {
+                    Fail(Error::Malformed);
+                    return;
+                }
+                numOps--;
+            } else if (c == '|' || c == '.') {
+                while (numOps > 0 && ops[numOps - 1] != '(' && Precedence(ops[numOps - 1]) >= Precedence(c))
+                    Output(ops[--numOps], rule);
+                Push(c);
+            } else if (c == '[' || static_cast<unsigned char>(c) >= 0x80) {
+                Fail(Error::Utf8);
+            }
+        }
+        while (numOps > 0)
+            Output(ops[--numOps], rule);
+        if (a.error != Error::None)
+            return;
+        if (numSets != 1) {
+            Fail(Error::Malformed);
+            return;
+        }
+
+        const PositionSets& top = sets[0];
+        if (top.nullable)
+            Fail(Error::AcceptsEmpty);
+        a.follow[0] |= top.first;
+        a.finals |= top.last;
+    }
+
+private:
+    constexpr void Fail(const Error error) {
+        if (a.error == Error::None)
+            a.error = error;
+    }
+
+    constexpr void Push(const char op) {
+        if (numOps == MaxDepth)
+            Fail(Error::TooDeep);
+        else
+            ops[numOps++] = op;
+    }
+
+    constexpr void FollowEach(const Positions& from, const Positions& to) {
+        from.ForEach([&](const std::size_t p) { a.follow[p] |= to; });
+    }
+
+    // the postfix step of PostfixToPositions for one symbol or operator
+    constexpr void Output(const char c, const int rule) {
+        if (a.error != Error::None)
+            return;
+        if (IsOperand(c)) {
+            if (a.numPositions == MaxPositions) {
+                Fail(Error::TooManyPositions);
+            } else if (numSets == MaxDepth) {
+                Fail(Error::TooDeep);
+            } else {
+                const std::size_t p = a.numPositions++;
+                a.symbol[p] = c;
+                a.rule[p] = rule;
+                PositionSets& s = sets[numSets++];
+                s = PositionSets();
+                s.first.Set(p);
+                s.last.Set(p);
+            }
+        } else if (c == '*') {
+            if (numSets < 1) {
+                Fail(Error::Malformed);
+                return;
+            }
+            PositionSets& s = sets[numSets - 1];
+            FollowEach(s.last, s.first);
+            s.nullable = true;
+        } else if (c == '.' || c == '|') {
+            if (numSets < 2) {
+                Fail(Error::Malformed);
+                return;
+            }
+            const PositionSets b = sets[--numSets];
+            PositionSets& s = sets[numSets - 1];
+            if (c == '.') {
+                FollowEach(s.last, b.first);
+                if (s.nullable)
+                    s.first |= b.first;
+                Positions last = b.last;
+                if (b.nullable)
+                    last |= s.last;
+                s.last = last;
+                s.nullable = s.nullable && b.nullable;
+            } else {
+                s.first |= b.first;
+                s.last |= b.last;
+                s.nullable = s.nullable || b.nullable;
+            }
+        } else {
+            Fail(Error::Malformed); // an unmatched '('
+        }
+    }
+
+    Automaton& a;
+    std::array<char, MaxDepth> ops{};
+    std::size_t numOps = 0;
+    std::array<PositionSets, MaxDepth> sets{};
+    std::size_t numSets = 0;
+};
+
+//---------------------------------------------------------------------------------
+// Moore's partition refinement: states start out split by the token they accept
+// and are split again while two in a block move to different blocks on some
+// class; then each block becomes one state. blocks are numbered by their first
+// state, so the dead state stays 0 and the start 1, and a block's first state is
+// never before it: the table can be rewritten in place
+//---------------------------------------------------------------------------------
+constexpr void Minimize(Table& table) {
+    const int n = table.numStates;
+    const int k = table.numClasses;
+    std::array<int, MaxStates> block{};
+    int numBlocks = 0;
+    std::array<int, MaxRules + 1> blockOfToken{}; // block + 1 of the states accepting token - 1
+    for (int s = 0; s < n; s++) {
+        int& b = blockOfToken[table.accept[s] + 1];
+        if (b == 0)
+            b = ++numBlocks;
+        block[s] = b - 1;
+    }
+
+    // two states stay together if they were and every class moves them together
+    const auto same = [&](const int s, const int t) {
+        if (block[s] != block[t])
+            return false;
+        for (int c = 1; c < k; c++)
+            if (block[table.next[s * k + c]] != block[table.next[t * k + c]]) return false;
+        return true;
+    };
+    std::array<int, MaxStates> first{}; // the first state of each block
+    while (true) {
+        std::array<int, MaxStates> refined{};
+        std::array<int, 2 * MaxStates> index{}; // open addressing over the new blocks, block + 1
+        int numRefined = 0;
+        for (int s = 0; s < n; s++) {
+            std::uint64_t h = 14695981039346656037ull ^ static_cast<std::uint64_t>(block[s]);
+            for (int c = 1; c < k; c++)
+                h = (h * 1099511628211ull) ^ static_cast<std::uint64_t>(block[table.next[s * k + c]]);
+            std::size_t slot = static_cast<std::size_t>(h ^ (h >> 32)) % index.size();
+            while (index[slot] != 0 && !same(first[index[slot] - 1], s))
+                slot = (slot + 1) % index.size();
+            if (index[slot] == 0) {
+                first[numRefined] = s;
+                index[slot] = ++numRefined;
+            }
+            refined[s] = index[slot] - 1;
+        }
+        // refining only ever splits blocks, so an unchanged count means stable
+        const bool stable = numRefined == numBlocks;
+        block = refined;
+        numBlocks = numRefined;
+        if (stable)
+            break;
+    }
+
+    for (int b = 0; b < numBlocks; b++) {
+        const int s = first[b];
+        for (int c = 0; c < k; c++)
+            table.next[b * k + c] = static_cast<unsigned char>(block[table.next[s * k + c]]);
+        table.accept[b] = table.accept[s];
+    }
+    table.removedStates = n - numBlocks;
+    table.numStates = numBlocks;
+}
+
+//---------------------------------------------------------------------------------
+// split the definitions line like ParseDefinitions, build the position
+// automaton of every rule, then determinize and minimize it. moves into a position are
+// always on its symbol, so from a set S the move on class k is simply
+//     (union of follow(p) over p in S) & entered(k)
+//---------------------------------------------------------------------------------
+constexpr Table Compile(const std::string_view spec) {
+    Table table;
+    Automaton automaton;
+
+    std::size_t from = 0;
+    while (from < spec.size() && automaton.error == Error::None) {
+        std::size_t end = spec.find(',', from);
+        if (end == std::string_view::npos)
+            end = spec.size();
+        std::size_t begin = from;
+        from = end + 1;
+        while (begin < end && (spec[begin] == ' ' || spec[begin] == '\t'))
+            begin++;
+        while (end > begin && (spec[end - 1] == ' ' || spec[end - 1] == '\t'))
+            end--;
+        if (begin == end)
+            continue;
+        if (spec.substr(begin, end - begin) == "#")
+            break;
+        if (table.numRules == static_cast<int>(MaxRules)) {
+            table.error = Error::TooManyRules;
+            return table;
+        }
+
+        std::size_t nameEnd = begin;
+        while (nameEnd < end && !IsSpace(spec[nameEnd]))
+            nameEnd++;
+        table.nameBegin[table.numRules] = begin;
+        table.nameLength[table.numRules] = nameEnd - begin;
+        RegexBuilder(automaton).Build(spec.substr(nameEnd, end - nameEnd), table.numRules);
+        table.numRules++;
+    }
+    if (automaton.error != Error::None) {
+        table.error = automaton.error;
+        return table;
+    }
+    // with no rules the start state would be merged into the dead one
+    if (table.numRules == 0) {
+        table.error = Error::NoRules;
+        return table;
+    }
+
+    // one class per letter in use, every other byte is class 0 and dead
+    std::array<Positions, MaxClasses> entered{};
+    for (std::size_t p = 1; p < automaton.numPositions; p++) {
+        const unsigned char c = static_cast<unsigned char>(automaton.symbol[p]);
+        if (table.byteClass[c] == 0)
+            table.byteClass[c] = static_cast<unsigned char>(table.numClasses++);
+        entered[table.byteClass[c]].Set(p);
+    }
+
+    // the sets found so far, with an open-addressing index of them (0 is empty)
+    std::array<Positions, MaxStates> states{};
+    std::array<int, 2 * MaxStates> index{};
+    states[1].Set(0);
+    index[states[1].Hash() % index.size()] = 1;
+    table.numStates = 2;
+    for (int s = 1; s < table.numStates; s++) {
+        Positions follows;
+        table.accept[s] = -1;
+        states[s].ForEach([&](const std::size_t p) { follows |= automaton.follow[p]; });
+        // the earliest definition wins
+        (states[s] & automaton.finals).ForEach([&](const std::size_t p) {
+            if (table.accept[s] < 0 || automaton.rule[p] < table.accept[s])
+                table.accept[s] = automaton.rule[p];
+        });
+        for (int k = 1; k < table.numClasses; k++) {
+            const Positions target = follows & entered[k];
+            if (target.Empty())
+                continue;
+            std::size_t slot = target.Hash() % index.size();
+            while (index[slot] != 0 && !(states[index[slot]] == target))
+                slot = (slot + 1) % index.size();
+            if (index[slot] == 0) {
+                if (table.numStates == static_cast<int>(MaxStates)) {
+                    table.error = Error::TooManyStates;
+                    return table;
+                }
+                states[table.numStates] = target;
+                index[slot] = table.numStates++;
+            }
+            const int t = index[slot];
+            table.next[s * table.numClasses + k] = static_cast<unsigned char>(t);
+        }
+    }
+    table.accept[0] = -1;
+    Minimize(table);
+    return table;
+}
+
+template <std::size_t N, class T, std::size_t Capacity>
+constexpr std::array<T, N> Prefix(const std::array<T, Capacity>& full) {
+    std::array<T, N> prefix{};
+    for (std::size_t i = 0; i < N; i++)
+        prefix[i] = full[i];
+    return prefix;
+}
+
+} // namespace static_lexer
+
+template <const char* Spec>
+class StaticLexer {
+    static constexpr static_lexer::Table compiled = static_lexer::Compile(Spec);
+    static_assert(compiled.error != static_lexer::Error::NoRules, "StaticLexer: the spec defines no tokens");
+    static_assert(compiled.error != static_lexer::Error::Malformed, "StaticLexer: a token regex is malformed");
+    static_assert(compiled.error != static_lexer::Error::AcceptsEmpty, "StaticLexer: a token accepts the empty string");
+    static_assert(compiled.error != static_lexer::Error::TooManyRules, "StaticLexer: more than MaxRules tokens");
+    static_assert(compiled.error != static_lexer::Error::TooManyPositions, "StaticLexer: more than MaxPositions symbols");
+    static_assert(compiled.error != static_lexer::Error::TooManyStates, "StaticLexer: DFA has more than MaxStates states");
+    static_assert(compiled.error != static_lexer::Error::TooDeep, "StaticLexer: a token regex nests deeper than MaxDepth");
+    static_assert(compiled.error != static_lexer::Error::Utf8, "StaticLexer: classes and UTF-8 operands are not supported");
+
+    static constexpr int numClasses = compiled.numClasses;
+    static constexpr int numStates = compiled.numStates;
+    static constexpr std::array<unsigned char, 256> byteClass = compiled.byteClass;
+    static constexpr auto next = static_lexer::Prefix<numStates * numClasses>(compiled.next);
+    static constexpr auto accept = static_lexer::Prefix<numStates>(compiled.accept);
+    static constexpr auto nameBegin = static_lexer::Prefix<compiled.numRules>(compiled.nameBegin);
+    static constexpr auto nameLength = static_lexer::Prefix<compiled.numRules>(compiled.nameLength);
+
+public:
+    static constexpr int NumTokens() { return compiled.numRules; }
+    static constexpr int NumStates() { return numStates; }
+    static constexpr int RemovedStates() { return compiled.removedStates; }
+    static constexpr std::string_view GetTokenName(const int id) {
+        return std::string_view(Spec).substr(nameBegin[id], nameLength[id]);
+    }
+
+    // length of the longest token at text[from..], 0 if none; token is set to
+    // its definition index (earliest definition on ties)
+    static constexpr std::size_t Match(const std::string_view text, const std::size_t from, int& token) {
+        token = -1;
+        std::size_t best = 0;
+        int s = 1;
+        for (std::size_t i = from; i < text.size(); i++) {
+            s = next[s * numClasses + byteClass[static_cast<unsigned char>(text[i])]];
+            if (s == 0)
+                break;
+            if (accept[s] >= 0) {
+                token = accept[s];
+                best = i + 1 - from;
+            }
+        }
+        return best;
+    }
+
+    constexpr explicit StaticLexer(const std::string_view input) : input(input) {}
+
+    // the same tokens as Lexer::getToken on the same definitions
+    constexpr static_lexer::Token Next() {
+        while (pos < input.size() && static_lexer::IsSpace(input[pos]))
+            pos++;
+        if (pos >= input.size())
+            return {static_lexer::EOS, "EOS", {}, 0};
+
+        const std::size_t start = pos;
+        int token = -1;
+        const std::size_t length = Match(input, start, token);
+        if (length == 0) {
+            pos++;
+            return {static_lexer::INVALID, "INVALID", input.substr(start, 1), start};
+        }
+        pos += length;
+        return {token, GetTokenName(token), input.substr(start, length), start};
+    }
+
+private:
+    std::string_view input;
+    std::size_t pos = 0;
+};
+
+#endif
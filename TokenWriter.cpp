@@ -0,0 +1,81 @@
+#include "TokenWriter.h"
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include "BinaryIO.h"
+
+using namespace std;
+
+static const char tokensMagic[8] = {'L', 'E', 'X', 'T', 'O', 'K', 'S', '\0'};
+static const uint32_t tokensVersion = 1;
+
+TokenWriter::TokenWriter(const int fd, const Format format, const size_t bufferBytes)
+    : fd(fd), format(format), buffer(max<size_t>(bufferBytes, 64), '\0') {}
+
+void TokenWriter::Begin(const LexerSpec& spec) {
+    if (format != BINARY)
+        return;
+    BinaryWriter header;
+    header.PutBytes(tokensMagic, sizeof(tokensMagic));
+    header.Put<uint32_t>(tokensVersion);
+    header.Put<uint32_t>(static_cast<uint32_t>(spec.NumTokens()));
+    for (int id = 0; id < spec.NumTokens(); id++)
+        header.PutString(spec.GetTokenName(id));
+    Append(header.GetData());
+}
+
+void TokenWriter::Write(const Token& token) {
+    if (format == BINARY) {
+        const TokenRecord record{token.id, static_cast<uint32_t>(token.lexeme.size()), token.offset};
+        Append({reinterpret_cast<const char*>(&record), sizeof(record)});
+        return;
+    }
+    Append(token.tokenName);
+    Append(" , \"");
+    Append(token.lexeme);
+    Append("\"\n");
+}
+
+void TokenWriter::End(const size_t endOffset) {
+    if (format == BINARY)
+        Write(Token(Token::EOS, "EOS", {}, endOffset));
+}
+
+void TokenWriter::WriteText(const string_view text) {
+    Append(text);
+}
+
+//---------------------------------------------------------------------------------
+// copy into the buffer, writing it out when full; pieces larger than the
+// whole buffer go straight to the descriptor
+//---------------------------------------------------------------------------------
+void TokenWriter::Append(const string_view bytes) {
+    if (used + bytes.size() > buffer.size()) {
+        Flush();
+        if (bytes.size() > buffer.size()) {
+            WriteAll(bytes);
+            return;
+        }
+    }
+    memcpy(&buffer[used], bytes.data(), bytes.size());
+    used += bytes.size();
+}
+
+bool TokenWriter::Flush() {
+    WriteAll({buffer.data(), used});
+    used = 0;
+    return ok;
+}
+
+void TokenWriter::WriteAll(string_view bytes) {
+    while (ok && !bytes.empty()) {
+        const ssize_t written = write(fd, bytes.data(), bytes.size());
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0) {
+            ok = false;
+            break;
+        }
+        bytes.remove_prefix(static_cast<size_t>(written));
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef TOKENWRITER_H
+#define TOKENWRITER_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "lexer.h"
+
+//---------------------------------------------------------------------------------
+// binary token stream layout (host byte order):
+//   magic "LEXTOKS\0", u32 version, u32 token count,
+//   each token name as u32 length + bytes,
+//   then one TokenRecord per token, ending with an EOS record whose
+//   offset is where the scan stopped
+//---------------------------------------------------------------------------------
+struct TokenRecord {
+    int32_t id;      // definition index, or Token::INVALID / Token::EOS
+    uint32_t length; // lexeme length
+    uint64_t offset; // lexeme position in the input
+};
+static_assert(sizeof(TokenRecord) == 16, "token records are written as raw bytes");
+
+//---------------------------------------------------------------------------------
+// class TokenWriter
+// formats tokens into one reusable buffer and hands it to the file descriptor
+// with a single write per buffer, as text (name , "lexeme" lines) or as binary
+// records. the writer flushes when it is destroyed
+//---------------------------------------------------------------------------------
+class TokenWriter {
+public:
+    enum Format { TEXT, BINARY };
+
+    TokenWriter(int fd, Format format, size_t bufferBytes = 1 << 20);
+    ~TokenWriter() { Flush(); }
+    TokenWriter(const TokenWriter&) = delete;
+    TokenWriter& operator=(const TokenWriter&) = delete;
+
+    // a token stream: Begin writes the binary header, End the EOS record
+    void Begin(const LexerSpec& spec);
+    void Write(const Token& token);
+    void End(size_t endOffset);
+    void WriteText(std::string_view text); // passed through as is
+    bool Flush();                          // false once any write failed
+
+private:
+    void Append(std::string_view bytes);
+    void WriteAll(std::string_view bytes);
+
+    int fd;
+    Format format;
+    std::string buffer;
+    size_t used = 0;
+    bool ok = true;
+};
+
+#endif
@@ -0,0 +1,154 @@
+#include "Utf8.h"
+#include <algorithm>
+#include <utility>
+
+using namespace std;
+
+constexpr char32_t MaxCodePoint = 0x10FFFF;
+constexpr char32_t SurrogateFirst = 0xD800;
+constexpr char32_t SurrogateLast = 0xDFFF;
+
+bool DecodeUtf8(const string& text, size_t& pos, char32_t& codePoint) {
+    const unsigned char lead = static_cast<unsigned char>(text[pos++]);
+    int length;
+    if (lead < 0x80) {
+        codePoint = lead;
+        return true;
+    } else if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+        codePoint = lead & 0x1F;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        length = 3;
+        codePoint = lead & 0x0F;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        codePoint = lead & 0x07;
+    } else {
+        return false;
+    }
+    size_t next = pos;
+    for (int i = 1; i < length; i++, next++) {
+        if (next >= text.size() || (static_cast<unsigned char>(text[next]) & 0xC0) != 0x80)
+            return false;
+        codePoint = codePoint << 6 | (static_cast<unsigned char>(text[next]) & 0x3F);
+    }
+    // overlong encodings, surrogates and values past U+10FFFF are malformed
+    static constexpr char32_t smallest[5] = {0, 0, 0x80, 0x800, 0x10000};
+    if (codePoint < smallest[length] || codePoint > MaxCodePoint
+        || (codePoint >= SurrogateFirst && codePoint <= SurrogateLast))
+        return false;
+    pos = next;
+    return true;
+}
+
+static int EncodeUtf8(const char32_t codePoint, unsigned char (&bytes)[4]) {
+    if (codePoint < 0x80) {
+        bytes[0] = static_cast<unsigned char>(codePoint);
+        return 1;
+    }
+    const int length = codePoint < 0x800 ? 2 : codePoint < 0x10000 ? 3 : 4;
+    static constexpr unsigned char leadMark[5] = {0, 0, 0xC0, 0xE0, 0xF0};
+    char32_t rest = codePoint;
+    for (int i = length - 1; i > 0; i--, rest >>= 6)
+        bytes[i] = static_cast<unsigned char>(0x80 | (rest & 0x3F));
+    bytes[0] = static_cast<unsigned char>(leadMark[length] | rest);
+    return length;
+}
+
+//---------------------------------------------------------------------------------
+// Russ Cox's range splitting (as in RE2): cut the range where the encoded
+// length changes, then wherever a continuation byte would not run over its
+// whole 80-BF span, until the lowest and highest encodings of every piece
+// differ only in bytes whose every value in between is also in the piece
+//---------------------------------------------------------------------------------
+vector<ByteSequence> Utf8Sequences(const char32_t low, const char32_t high) {
+    vector<ByteSequence> sequences;
+    // pieces still to split; the lower half is pushed last so it comes out first
+    vector<pair<char32_t, char32_t>> pending{{low, min(high, MaxCodePoint)}};
+    const auto split = [&](const char32_t lo, const char32_t mid, const char32_t hi) {
+        pending.emplace_back(mid + 1, hi);
+        pending.emplace_back(lo, mid);
+    };
+    while (!pending.empty()) {
+        const auto [lo, hi] = pending.back();
+        pending.pop_back();
+        if (lo > hi)
+            continue;
+        if (lo <= SurrogateLast && hi >= SurrogateFirst) {
+            pending.emplace_back(SurrogateLast + 1, hi);
+            if (lo < SurrogateFirst)
+                pending.emplace_back(lo, SurrogateFirst - 1);
+            continue;
+        }
+
+        bool wasSplit = false;
+        for (const char32_t lastOfLength : {char32_t{0x7F}, char32_t{0x7FF}, char32_t{0xFFFF}}) {
+            if (lo <= lastOfLength && hi > lastOfLength) {
+                split(lo, lastOfLength, hi);
+                wasSplit = true;
+                break;
+            }
+        }
+        for (int i = 1; i < 4 && !wasSplit; i++) {
+            const char32_t tail = (char32_t{1} << (6 * i)) - 1; // the low i continuation bytes
+            if ((lo & ~tail) == (hi & ~tail))
+                continue;
+            if ((lo & tail) != 0) {
+                split(lo, lo | tail, hi);
+                wasSplit = true;
+            } else if ((hi & tail) != tail) {
+                split(lo, (hi & ~tail) - 1, hi);
+                wasSplit = true;
+            }
+        }
+        if (wasSplit)
+            continue;
+
+        unsigned char first[4];
+        unsigned char last[4];
+        const int length = EncodeUtf8(lo, first);
+        EncodeUtf8(hi, last);
+        ByteSequence sequence;
+        for (int i = 0; i < length; i++)
+            sequence.push_back({first[i], last[i]});
+        sequences.push_back(std::move(sequence));
+    }
+    return sequences;
+}
+
+vector<ByteSequence> ClassSequences(const string& body) {
+    // the code point ranges, sorted and merged so no encoding is repeated
+    vector<pair<char32_t, char32_t>> ranges;
+    for (size_t pos = 0; pos < body.size();) {
+        char32_t low;
+        if (!DecodeUtf8(body, pos, low))
+            continue;
+        char32_t high = low;
+        if (size_t next = pos + 1; pos < body.size() && body[pos] == '-' && next < body.size()
+                                   && DecodeUtf8(body, next, high))
+            pos = next;
+        if (low <= high)
+            ranges.emplace_back(low, high);
+    }
+    sort(ranges.begin(), ranges.end());
+    vector<pair<char32_t, char32_t>> merged;
+    for (const auto& range : ranges) {
+        if (!merged.empty() && range.first <= merged.back().second + 1)
+            merged.back().second = max(merged.back().second, range.second);
+        else
+            merged.push_back(range);
+    }
+
+    vector<ByteSequence> sequences;
+    for (const auto& [low, high] : merged) {
+        for (const auto& [a, z] : {make_pair(char32_t{'A'}, char32_t{'Z'}), make_pair(char32_t{'a'}, char32_t{'z'})}) {
+            if (max(low, a) <= min(high, z))
+                sequences.push_back({{static_cast<unsigned char>(max(low, a)), static_cast<unsigned char>(min(high, z))}});
+        }
+        if (high >= 0x80) {
+            for (ByteSequence& sequence : Utf8Sequences(max(low, char32_t{0x80}), high))
+                sequences.push_back(std::move(sequence));
+        }
+    }
+    return sequences;
+}
@@ -0,0 +1,36 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+//---------------------------------------------------------------------------------
+// UTF-8 operands compiled to bytes: a code point range becomes a few sequences
+// of byte ranges, one range per byte of the encoding, so automata built from
+// them stay 256 symbols wide however large the range is
+//---------------------------------------------------------------------------------
+
+// the bytes low..high
+struct ByteRange {
+    unsigned char low;
+    unsigned char high;
+};
+
+using ByteSequence = std::vector<ByteRange>;
+
+// decode the code point at text[pos] and move pos past it. a byte that does
+// not start a well-formed encoding is skipped by itself and false returned
+bool DecodeUtf8(const std::string& text, size_t& pos, char32_t& codePoint);
+
+// the encodings of every scalar value in [low, high] (surrogates have none)
+// as the fewest byte range sequences matching exactly them, in code point
+// order: U+0400..U+04FF is the one sequence [D0-D3][80-BF]
+std::vector<ByteSequence> Utf8Sequences(char32_t low, char32_t high);
+
+// the sequences of a class operand's body, the text between '[' and ']':
+// characters and ranges x-y of them. as elsewhere in a regex, the only ASCII
+// operands are letters, so [!-~] is the same as [A-Za-z]
+std::vector<ByteSequence> ClassSequences(const std::string& body);
+
+#endif
@@ -0,0 +1,438 @@
+/*----------------------------------------------------------------------
+Compile and scan throughput of the lexer on synthetic token specs.
+The options are listed in Usage (before main).
+Every case reports the time of each compile phase per rule (regex to
+postfix, Thompson and Glushkov construction, subset construction of
+each) with the NFA and DFA sizes, then compiles the whole spec and
+scans a generated input once per scan mode. The adversarial cases are a spec whose DFA blows up
+exponentially and one on which plain maximal munch is quadratic. The
+static_keywords case also scans with the spec compiled into the bench
+by StaticLexer.
+----------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "lexer.h"
+#include "ParseCount.h"
+#include "shunting.h"
+#include "StaticLexer.h"
+
+using namespace std;
+
+//--------------------------------------------------------------
+// a regex syntax tree, so a generated rule can also generate
+// lexemes it matches
+//--------------------------------------------------------------
+struct Expr {
+    enum Kind { LEAF, ALT, CAT, STAR } kind;
+    char symbol = 0;
+    vector<unique_ptr<Expr>> parts;
+
+    string Regex() const {
+        switch (kind) {
+            case LEAF: return string(1, symbol);
+            case ALT: return "(" + parts[0]->Regex() + "|" + parts[1]->Regex() + ")";
+            case CAT: return "(" + parts[0]->Regex() + "." + parts[1]->Regex() + ")";
+            default: return "(" + parts[0]->Regex() + ")*";
+        }
+    }
+
+    void Sample(mt19937& rng, string& out) const {
+        switch (kind) {
+            case LEAF: out += symbol; break;
+            case ALT: parts[rng() % 2]->Sample(rng, out); break;
+            case CAT: parts[0]->Sample(rng, out); parts[1]->Sample(rng, out); break;
+            default:
+                for (unsigned n = rng() % 3; n > 0; n--)
+                    parts[0]->Sample(rng, out);
+        }
+    }
+};
+
+static unique_ptr<Expr> Leaf(const char symbol) {
+    auto e = make_unique<Expr>();
+    e->kind = Expr::LEAF;
+    e->symbol = symbol;
+    return e;
+}
+
+static unique_ptr<Expr> Node(const Expr::Kind kind, unique_ptr<Expr> a, unique_ptr<Expr> b = nullptr) {
+    auto e = make_unique<Expr>();
+    e->kind = kind;
+    e->parts.push_back(std::move(a));
+    if (b)
+        e->parts.push_back(std::move(b));
+    return e;
+}
+
+// a random tree of the given depth over the letters a..h; starProb is the
+// chance that an inner node is starred
+static unique_ptr<Expr> RandomExpr(mt19937& rng, const int depth, const double starProb) {
+    if (depth == 0)
+        return Leaf(static_cast<char>('a' + rng() % 8));
+    auto e = Node(rng() % 2 ? Expr::ALT : Expr::CAT, RandomExpr(rng, depth - 1, starProb),
+                  RandomExpr(rng, depth - 1, starProb));
+    if (uniform_real_distribution<double>(0, 1)(rng) < starProb)
+        e = Node(Expr::STAR, std::move(e));
+    return e;
+}
+
+struct Rule {
+    string name;
+    string regex;
+};
+
+struct ScanMode {
+    string name;
+    LexerOptions options;
+};
+
+struct Case {
+    string name;
+    vector<Rule> rules;
+    string input;
+    vector<ScanMode> modes;
+    // scan with the same spec compiled by StaticLexer, if it is one
+    size_t (*staticScan)(const string& input, size_t& invalid) = nullptr;
+    int staticStates = 0;
+    int staticRemoved = 0;
+};
+
+static string SpecLine(const vector<Rule>& rules) {
+    string spec;
+    for (const Rule& rule : rules)
+        spec += rule.name + " " + rule.regex + " , ";
+    return spec + "#";
+}
+
+static string Word(mt19937& rng, const size_t minLength, const size_t maxLength) {
+    string word(minLength + rng() % (maxLength - minLength + 1), ' ');
+    for (char& c : word)
+        c = static_cast<char>('a' + rng() % 26);
+    return word;
+}
+
+static string Concat(const string& word) {
+    string regex;
+    for (const char c : word)
+        regex += regex.empty() ? string(1, c) : string(".") + c;
+    return regex;
+}
+
+static ScanMode Mode(const string& name, const bool lazy, const bool linear, const bool glushkov = false,
+                     const bool bitParallel = false) {
+    ScanMode mode{name, LexerOptions()};
+    mode.options.lazy = lazy;
+    mode.options.linear = linear;
+    mode.options.glushkov = glushkov;
+    mode.options.bitParallel = bitParallel;
+    mode.options.compileThreads = 1;
+    return mode;
+}
+
+static const vector<ScanMode> defaultModes = {Mode("eager", false, false), Mode("eager_glushkov", false, false, true),
+                                              Mode("lazy", true, false), Mode("bit_parallel", false, false, false, true)};
+
+//--------------------------------------------------------------
+// the synthetic cases
+//--------------------------------------------------------------
+
+// many keywords plus an identifier rule, input of keywords and identifiers
+static Case Keywords(mt19937& rng, const int scale) {
+    Case c{"keywords", {}, {}, defaultModes};
+    vector<string> words;
+    for (int i = 0; i < 100 * scale; i++) {
+        words.push_back(Word(rng, 2, 8));
+        c.rules.push_back({"KW" + to_string(i), Concat(words.back())});
+    }
+    string letters = "(a";
+    for (char l = 'b'; l <= 'z'; l++)
+        letters += string("|") + l;
+    letters += ")";
+    c.rules.push_back({"ID", letters + "." + letters + "*"});
+    while (c.input.size() < (4u << 20) * scale)
+        c.input += (rng() % 2 ? words[rng() % words.size()] : Word(rng, 1, 12)) + " ";
+    return c;
+}
+
+// deep trees of nested alternation and concatenation, or star-heavy ones;
+// every rule starts with a letter so none accepts the empty string
+static Case RandomRules(mt19937& rng, const string& name, const int scale, const int depth, const double starProb) {
+    Case c{name, {}, {}, defaultModes};
+    vector<unique_ptr<Expr>> exprs;
+    for (int i = 0; i < 20 * scale; i++) {
+        exprs.push_back(Node(Expr::CAT, Leaf(static_cast<char>('a' + rng() % 8)), RandomExpr(rng, depth, starProb)));
+        c.rules.push_back({"R" + to_string(i), exprs.back()->Regex()});
+    }
+    while (c.input.size() < (4u << 20) * scale) {
+        exprs[rng() % exprs.size()]->Sample(rng, c.input);
+        c.input += ' ';
+    }
+    return c;
+}
+
+// (a|b)*.a.(a|b)^k: the DFA must remember the last k+1 symbols, 2^(k+1) states
+static Case Blowup(mt19937& rng, const int scale) {
+    Case c{"adversarial_dfa_blowup", {}, {}, defaultModes};
+    string regex = "(a|b)*.a";
+    for (int i = 0; i < 12; i++)
+        regex += ".(a|b)";
+    c.rules.push_back({"T", regex});
+    c.input.resize((1u << 20) * scale);
+    for (size_t i = 0; i < c.input.size(); i++)
+        c.input[i] = (i + 1) % 64 == 0 ? ' ' : static_cast<char>('a' + rng() % 2);
+    return c;
+}
+
+// a run of a's with no b: every token is one a, but plain maximal munch scans
+// the rest of the run for a*.b each time
+static Case QuadraticMunch(const int scale) {
+    Case c{"adversarial_quadratic_munch", {{"A", "a"}, {"AB", "a*.b"}}, string(20000u * scale, 'a'),
+           {Mode("eager", false, false), Mode("eager_linear", false, true)}};
+    return c;
+}
+
+// a fixed keyword spec, also compiled into the bench itself by StaticLexer
+static constexpr char staticSpec[] =
+    "IF i.f , ELSE e.l.s.e , WHILE w.h.i.l.e , FOR f.o.r , RETURN r.e.t.u.r.n , INT i.n.t , "
+    "ID (a|b|c|d|e|f|g|h|i|j|k|l|m|n|o|p|q|r|s|t|u|v|w|x|y|z)"
+    ".(a|b|c|d|e|f|g|h|i|j|k|l|m|n|o|p|q|r|s|t|u|v|w|x|y|z)* , #";
+
+template <const char* Spec>
+static size_t StaticScan(const string& input, size_t& invalid) {
+    StaticLexer<Spec> lexer(input);
+    size_t tokens = 0;
+    invalid = 0;
+    for (auto token = lexer.Next(); token.id != static_lexer::EOS; token = lexer.Next()) {
+        tokens++;
+        invalid += token.id == static_lexer::INVALID;
+    }
+    return tokens;
+}
+
+// true if StaticLexer splits input into the space separated token names
+template <const char* Spec>
+static constexpr bool StaticTokens(const string_view input, const string_view names) {
+    StaticLexer<Spec> lexer(input);
+    size_t pos = 0;
+    for (auto token = lexer.Next(); token.id != static_lexer::EOS; token = lexer.Next()) {
+        if (pos >= names.size())
+            return false;
+        const string_view name = names.substr(pos, names.find(' ', pos) - pos);
+        if (name != token.tokenName)
+            return false;
+        pos += name.size() + 1;
+    }
+    return pos >= names.size();
+}
+
+// the table is checked while the bench compiles: keywords win ties with ID,
+// and the longest match wins over a keyword prefix
+static_assert(StaticLexer<staticSpec>::NumTokens() == 7, "StaticLexer: the keyword spec has 7 tokens");
+static_assert(StaticTokens<staticSpec>("if iff else elsewhere for1 Return", "IF ID ELSE ID FOR INVALID INVALID ID"),
+              "StaticLexer: the keyword spec lexes differently than the run time lexer");
+
+// the keywords and identifiers of the Keywords case, scanned by the run time
+// lexer and by StaticLexer on the same spec
+static Case StaticKeywords(mt19937& rng, const int scale) {
+    Case c{"static_keywords", {}, {}, {Mode("eager", false, false)}, StaticScan<staticSpec>,
+           StaticLexer<staticSpec>::NumStates(), StaticLexer<staticSpec>::RemovedStates()};
+    istringstream definitions(staticSpec);
+    vector<string> words;
+    for (string definition; getline(definitions, definition, ',');) {
+        istringstream fields(definition);
+        Rule rule;
+        if (!(fields >> rule.name >> rule.regex))
+            continue;
+        c.rules.push_back(rule);
+        if (rule.name != "ID") {
+            rule.regex.erase(remove(rule.regex.begin(), rule.regex.end(), '.'), rule.regex.end());
+            words.push_back(rule.regex);
+        }
+    }
+    while (c.input.size() < (4u << 20) * scale)
+        c.input += (rng() % 2 ? words[rng() % words.size()] : Word(rng, 1, 12)) + " ";
+    return c;
+}
+
+//--------------------------------------------------------------
+// timing
+//--------------------------------------------------------------
+template <class Body>
+static double BestSeconds(const int reps, Body&& body) {
+    double best = 1e300;
+    for (int r = 0; r < reps; r++) {
+        const auto begin = chrono::steady_clock::now();
+        body();
+        best = min(best, chrono::duration<double>(chrono::steady_clock::now() - begin).count());
+    }
+    return best;
+}
+
+static string Number(const double value) {
+    ostringstream out;
+    out.precision(6);
+    out << value;
+    return out.str();
+}
+
+// one NFA construction over every rule, then subset construction of each
+struct Construction {
+    double buildSeconds = 0;
+    double subsetSeconds = 0;
+    size_t nfaStates = 0;
+    size_t dfaStates = 0;
+};
+
+static Construction Construct(const vector<string>& postfixes, NFA (*build)(const string&), const int reps) {
+    Construction result;
+    vector<NFA> nfas(postfixes.size());
+    result.buildSeconds = BestSeconds(reps, [&] {
+        for (size_t i = 0; i < postfixes.size(); i++)
+            nfas[i] = build(postfixes[i]);
+    });
+    result.subsetSeconds = BestSeconds(reps, [&] {
+        result.dfaStates = 0;
+        for (NFA& nfa : nfas)
+            result.dfaStates += nfa.NFA2DFA().NumStates();
+    });
+    for (NFA& nfa : nfas)
+        result.nfaStates += nfa.GetMaxLabel() + 1;
+    return result;
+}
+
+static void RunCase(const Case& c, const int reps, ostream& json) {
+    cerr << "bench: " << c.name << "\n";
+    vector<string> postfixes(c.rules.size());
+    const double parse = BestSeconds(reps, [&] {
+        for (size_t i = 0; i < c.rules.size(); i++)
+            postfixes[i] = InfixToPostfix(c.rules[i].regex);
+    });
+    // Thompson and Glushkov side by side
+    const Construction thompson = Construct(postfixes, PostfixToNFA, reps);
+    const Construction glushkov = Construct(postfixes, PostfixToGlushkovNFA, reps);
+
+    json << "    {\"name\": \"" << c.name << "\", \"rules\": " << c.rules.size()
+         << ", \"input_bytes\": " << c.input.size() << ", \"parse_ms\": " << Number(parse * 1e3) << ",\n"
+         << "     \"thompson_ms\": " << Number(thompson.buildSeconds * 1e3)
+         << ", \"subset_ms\": " << Number(thompson.subsetSeconds * 1e3)
+         << ", \"nfa_states\": " << thompson.nfaStates << ", \"dfa_states\": " << thompson.dfaStates << ",\n"
+         << "     \"glushkov_ms\": " << Number(glushkov.buildSeconds * 1e3)
+         << ", \"glushkov_subset_ms\": " << Number(glushkov.subsetSeconds * 1e3)
+         << ", \"glushkov_nfa_states\": " << glushkov.nfaStates
+         << ", \"glushkov_dfa_states\": " << glushkov.dfaStates << ",\n"
+         << "     \"modes\": [\n";
+
+    const string spec = SpecLine(c.rules);
+    for (size_t m = 0; m < c.modes.size(); m++) {
+        const ScanMode& mode = c.modes[m];
+        shared_ptr<const LexerSpec> compiled;
+        const double compile = BestSeconds(reps, [&] {
+            compiled = make_shared<const LexerSpec>(spec, mode.options);
+        });
+        size_t tokens = 0;
+        size_t invalid = 0;
+        const double scan = BestSeconds(reps, [&] {
+            Lexer lexer(compiled, c.input, mode.options);
+            tokens = invalid = 0;
+            for (Token token = lexer.getToken(); token.id != Token::EOS; token = lexer.getToken()) {
+                tokens++;
+                invalid += token.id == Token::INVALID;
+            }
+        });
+        json << "       {\"mode\": \"" << mode.name << "\", \"compile_ms\": " << Number(compile * 1e3)
+             << ", \"combined_dfa_states\": " << (compiled->IsLazy() ? "null" : to_string(compiled->GetDFA().NumStates()))
+             << ", \"removed_states\": " << compiled->GetRemovedStates()
+             << ",\n        \"scan_ms\": " << Number(scan * 1e3) << ", \"tokens\": " << tokens
+             << ", \"invalid\": " << invalid
+             << ", \"mb_per_s\": " << Number(c.input.size() / 1e6 / scan)
+             << ", \"tokens_per_s\": " << Number(tokens / scan) << "}"
+             << (m + 1 < c.modes.size() || c.staticScan ? ",\n" : "\n");
+    }
+    if (c.staticScan) {
+        // compiled with the bench, so there is nothing to time but the scan
+        size_t tokens = 0;
+        size_t invalid = 0;
+        const double scan = BestSeconds(reps, [&] { tokens = c.staticScan(c.input, invalid); });
+        json << "       {\"mode\": \"static\", \"compile_ms\": 0, \"combined_dfa_states\": " << c.staticStates
+             << ", \"removed_states\": " << c.staticRemoved << ",\n        \"scan_ms\": " << Number(scan * 1e3) << ", \"tokens\": " << tokens
+             << ", \"invalid\": " << invalid
+             << ", \"mb_per_s\": " << Number(c.input.size() / 1e6 / scan)
+             << ", \"tokens_per_s\": " << Number(tokens / scan) << "}\n";
+    }
+    json << "     ]}";
+}
+
+//--------------------------------------------------------------
+// printed on stderr for a bad option
+//--------------------------------------------------------------
+static const char* const Usage = R"(usage: bench [--scale N] [--reps N] [--out FILE]
+Options:
+    --scale N    multiply input sizes and spec sizes by N (default 1)
+    --reps N     time every phase N times and keep the fastest (default 3)
+    --out FILE   write the JSON report to FILE instead of stdout
+)";
+
+static int BadOption(const string& problem) {
+    cerr << problem << "\n" << Usage;
+    return 1;
+}
+
+int main(int argc, char* argv[]) {
+    int scale = 1;
+    int reps = 3;
+    string outFile;
+    for (int i = 1; i < argc; i++) {
+        const string arg = argv[i];
+        if (arg == "--scale" && i + 1 < argc) {
+            if (!ParseCount(argv[++i], scale))
+                return BadOption("bad value " + string(argv[i]) + " for " + arg);
+            scale = max(1, scale);
+        } else if (arg == "--reps" && i + 1 < argc) {
+            if (!ParseCount(argv[++i], reps))
+                return BadOption("bad value " + string(argv[i]) + " for " + arg);
+            reps = max(1, reps);
+        } else if (arg == "--out" && i + 1 < argc) {
+            outFile = argv[++i];
+        } else {
+            return BadOption("unknown option " + arg);
+        }
+    }
+
+    // fixed seed, so every run measures the same specs and inputs
+    mt19937 rng(340);
+    vector<Case> cases;
+    cases.push_back(Keywords(rng, scale));
+    cases.push_back(RandomRules(rng, "nested_alternation", scale, 6, 0.0));
+    cases.push_back(RandomRules(rng, "star_heavy", scale, 4, 0.5));
+    cases.push_back(Blowup(rng, scale));
+    cases.push_back(QuadraticMunch(scale));
+    cases.push_back(StaticKeywords(rng, scale));
+
+    ofstream file;
+    if (!outFile.empty()) {
+        file.open(outFile);
+        if (!file) {
+            cerr << "cannot write " << outFile << "\n";
+            return 1;
+        }
+    }
+    ostream& json = outFile.empty() ? cout : file;
+    json << "{\"timestamp\": " << time(nullptr) << ", \"scale\": " << scale << ", \"reps\": " << reps
+         << ",\n  \"cases\": [\n";
+    for (size_t i = 0; i < cases.size(); i++) {
+        RunCase(cases[i], reps, json);
+        json << (i + 1 < cases.size() ? ",\n" : "\n");
+    }
+    json << "  ]}\n";
+    return 0;
+}
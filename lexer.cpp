@@ -2,40 +2,214 @@
 A basic lexer that reads token definitions and an input string from a file.
 Usage:
    g++ -std=c++17 *.cpp
-   ./a.out < charstream.txt > output.txt
+   ./a.out [options] < charstream.txt > output.txt
+The options are listed in Usage (before main), which --help prints.
 Format:
     t1_name t1_regex , t2_name t2_regex , ... , tk_name tk_regex #
     "string"
+Regex operands are letters, UTF-8 characters (é) and classes of
+characters and ranges ([a-zа-яё]), joined by . (concatenation), | and *.
+Classes compile to byte ranges, so UTF-8 input scans as fast as ASCII.
+A regex with an operator short of operands, an unmatched parenthesis,
+or a class without its ']' or without a single operand ([0-9]) is a
+syntax error.
 ----------------------------------------------------------------------*/
 
 #include <iostream>
+#include <fstream>
 #include <sstream>
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <cctype>
+#include <cstring>
+#include <thread>
+#include <chrono>
+#include <unistd.h>
 #include "DFA.h"
 #include "NFA.h"
 #include "shunting.h"
+#include "BitNFA.h"
 #include "lexer.h"
+#include "parallel.h"
+#include "ScannerGenerator.h"
+#include "SpecCache.h"
+#include "TokenWriter.h"
+#include "IncrementalLexer.h"
+#include "ParseCount.h"
 
 using namespace std;
 
-DFA regexToDFA(const string& regex) {
-    // convert regex from infix to postfix notation
-    const string postfix = InfixToPostfix(regex);
-    // build the NFA from the postfix regex
-    NFA nfa = PostfixToNFA(postfix);
-    // convert the NFA to a DFA
-    return nfa.NFA2DFA();
+// error message for an unusable spec: its malformed tokens, or
+// else the tokens that accept epsilon
+static string SpecError(const LexerSpec& spec) {
+    if (!spec.GetSyntaxErrorTokens().empty()) {
+        string error = "SYNTAX ERROR IN EXPRESSION OF ";
+        for (const string& e : spec.GetSyntaxErrorTokens())
+            error += e + " ";
+        return error;
+    }
+    string error = "EPSILON IS NOT A TOKEN ";
+    for (const string& e : spec.GetEpsilonTokens())
+        error += e + " ";
+    return error;
+}
+
+//--------------------------------------------------------------
+// compiled-lexer file layout (host byte order):
+//   magic "LEXSPEC\0", u32 version, u32 reserved,
+//   u64 payload size, u64 FNV-1a checksum of the payload,
+//   payload: u32 token count, each name as u32 length + bytes,
+//            then the DFA (see DFA::Save)
+//--------------------------------------------------------------
+static const char specMagic[8] = {'L', 'E', 'X', 'S', 'P', 'E', 'C', '\0'};
+static const uint32_t specVersion = 2; // 2: transition tables indexed by byte class
+
+bool LexerSpec::Save(const string& path, string& error) const {
+    if (lazy || !bitRules.empty()) {
+        error = "a lazy or bit-parallel spec has no DFA to save";
+        return false;
+    }
+    BinaryWriter payload;
+    payload.Put<uint32_t>(static_cast<uint32_t>(tokenNames.size()));
+    for (const string& name : tokenNames)
+        payload.PutString(name);
+    dfa.Save(payload);
+
+    BinaryWriter header;
+    header.PutBytes(specMagic, sizeof(specMagic));
+    header.Put<uint32_t>(specVersion);
+    header.Put<uint32_t>(0);
+    header.Put<uint64_t>(payload.GetData().size());
+    header.Put<uint64_t>(Checksum(payload.GetData()));
+
+    ofstream out(path, ios::binary | ios::trunc);
+    out.write(header.GetData().data(), static_cast<streamsize>(header.GetData().size()));
+    out.write(payload.GetData().data(), static_cast<streamsize>(payload.GetData().size()));
+    if (!out) {
+        error = "cannot write " + path;
+        return false;
+    }
+    return true;
+}
+
+shared_ptr<const LexerSpec> LexerSpec::Load(const string& path, string& error) {
+    const MappedFile file(path);
+    if (!file.IsOpen()) {
+        error = "cannot open " + path;
+        return nullptr;
+    }
+    BinaryReader header(file.GetText());
+    char magic[sizeof(specMagic)];
+    header.GetBytes(magic, sizeof(magic));
+    const uint32_t version = header.Get<uint32_t>();
+    header.Get<uint32_t>();
+    const uint64_t size = header.Get<uint64_t>();
+    const uint64_t checksum = header.Get<uint64_t>();
+    if (!header.IsOk() || memcmp(magic, specMagic, sizeof(specMagic)) != 0) {
+        error = path + " is not a compiled lexer";
+        return nullptr;
+    }
+    if (version != specVersion) {
+        error = path + " has unsupported version " + to_string(version);
+        return nullptr;
+    }
+    const size_t headerSize = sizeof(specMagic) + 2 * sizeof(uint32_t) + 2 * sizeof(uint64_t);
+    const string_view data = file.GetText().substr(headerSize);
+    if (data.size() != size || Checksum(data) != checksum) {
+        error = path + " is corrupt (checksum mismatch)";
+        return nullptr;
+    }
+
+    shared_ptr<LexerSpec> spec(new LexerSpec());
+    BinaryReader payload(data);
+    const uint32_t count = payload.Get<uint32_t>();
+    for (uint32_t i = 0; payload.IsOk() && i < count; i++)
+        spec->tokenNames.push_back(payload.GetString());
+    if (!payload.IsOk() || !spec->dfa.Load(payload) || !payload.AtEnd()) {
+        error = path + " is corrupt";
+        return nullptr;
+    }
+    for (int s = 0; s < spec->dfa.NumStates(); s++) {
+        if (spec->dfa.GetAcceptToken(s) >= spec->NumTokens()) {
+            error = path + " is corrupt";
+            return nullptr;
+        }
+    }
+    spec->FindStartBytes();
+    return spec;
 }
 
-Lexer::Lexer(const string& tokenDefs, const string& input) : input(input), pos(0) {
+//--------------------------------------------------------------
+// scan state shared by all lexer ctors; in lazy mode each lexer
+// gets its own DFA cache over the spec's NFA
+//--------------------------------------------------------------
+Lexer::Lexer(shared_ptr<const LexerSpec> spec, const LexerOptions& options)
+    : spec(std::move(spec)), options(options) {
+    if (this->spec->IsLazy())
+        lazyDFA = make_unique<LazyDFA>(this->spec->GetNFA(), options.lazyCacheBytes);
+}
+
+Lexer::Lexer(shared_ptr<const LexerSpec> spec, const string& input, const LexerOptions& options)
+    : Lexer(std::move(spec), options) {
+    buffer = input;
+    this->input = buffer;
+}
+
+Lexer::Lexer(const string& tokenDefs, const string& input, const LexerOptions& options)
+    : Lexer(make_shared<const LexerSpec>(tokenDefs, options), input, options) {
+    if (!spec->IsUsable()) {
+        cout << SpecError(*spec);
+        exit(1);  // stop the lexer from running
+    }
+}
+
+//--------------------------------------------------------------
+// lex a memory-mapped file in place; the file must outlive the lexer
+//--------------------------------------------------------------
+Lexer::Lexer(shared_ptr<const LexerSpec> spec, const MappedFile& file, const LexerOptions& options)
+    : Lexer(std::move(spec), options) {
+    input = file.GetText();
+}
+
+//--------------------------------------------------------------
+// lex a stream without holding it in memory: input is read in
+// fixed-size chunks as the scan reaches the end of what is buffered
+//--------------------------------------------------------------
+Lexer::Lexer(shared_ptr<const LexerSpec> spec, istream& source, const LexerOptions& options)
+    : Lexer(std::move(spec), options) {
+    this->source = &source;
+}
+
+//--------------------------------------------------------------
+// lex a view starting at a given position, used by TokenizeAll's
+// workers; the text must outlive the lexer
+//--------------------------------------------------------------
+Lexer::Lexer(shared_ptr<const LexerSpec> spec, const string_view text, const size_t start, const LexerOptions& options)
+    : Lexer(std::move(spec), options) {
+    input = text;
+    pos = start;
+}
+
+// wall time taken by body()
+template <class Body>
+static double Seconds(Body&& body) {
+    const auto begin = chrono::steady_clock::now();
+    body();
+    return chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+}
+
+//--------------------------------------------------------------
+// split a definition line into (token name, regex) pairs in
+// definition order
+//--------------------------------------------------------------
+static vector<pair<string, string>> ParseDefinitions(const string& tokenDefs) {
     // tokenDefs is a string like:
     // "t1 a|b , t2 a*.a , t3 (a|b)*.c*.c #"
     istringstream iss(tokenDefs);
     string tokenDef;
-    // collect error messages for tokens that accept epsilon
-    vector<string> errors;
+    // (token name, regex) pairs in definition order
+    vector<pair<string, string>> definitions;
     while(getline(iss, tokenDef, ',')) {
         // trim leading/trailing whitespace
         size_t start = tokenDef.find_first_not_of(" \t");
@@ -55,98 +229,785 @@ Lexer::Lexer(const string& tokenDefs, const string& input) : input(input), pos(0
         // remove any leading spaces from the regex
         if(size_t s2 = regex.find_first_not_of(" \t"); s2 != string::npos)
             regex = regex.substr(s2);
-        // build the DFA
-        DFA dfa = regexToDFA(regex);
+        definitions.emplace_back(tokenName, regex);
+    }
+    return definitions;
+}
 
-        if(dfa.AcceptsEmpty()) {
-            errors.push_back(tokenName);
+//--------------------------------------------------------------
+// the definitions with spacing normalized, so lines that differ
+// only in whitespace compile to the same spec
+//--------------------------------------------------------------
+string LexerSpec::Normalize(const string& tokenDefs) {
+    string normalized;
+    for (const auto& [name, regex] : ParseDefinitions(tokenDefs))
+        normalized += name + " " + regex + " , ";
+    return normalized + "#";
+}
+
+LexerSpec::LexerSpec(const string& tokenDefs, const LexerOptions& options) {
+    const vector<pair<string, string>> definitions = ParseDefinitions(tokenDefs);
+
+    // build each definition's NFA; they are independent, so large specs are
+    // spread over a worker pool (small ones aren't worth starting threads for)
+    vector<NFA> nfas(definitions.size());
+    vector<unique_ptr<BitNFA>> bitNFAs(definitions.size());
+    vector<char> acceptsEmpty(definitions.size());
+    vector<char> malformed(definitions.size());
+    const unsigned threads = options.compileThreads ? options.compileThreads : thread::hardware_concurrency();
+    stats.rules.resize(definitions.size());
+    stats.glushkov = options.glushkov;
+    ParallelFor(definitions.size(), definitions.size() >= 32 ? threads : 1, [&](const size_t i) {
+        RuleStats& rule = stats.rules[i];
+        rule.name = definitions[i].first;
+        string postfix;
+        rule.parseSeconds = Seconds([&] { postfix = InfixToPostfix(definitions[i].second); });
+        if (postfix.empty()) {
+            malformed[i] = true;
+            return;
+        }
+        // a short rule whose DFA would blow up is simulated bit-parallel and
+        // never determinized; the rest stay in the combined DFA, so a token
+        // still costs one scan
+        if (options.bitParallel) {
+            PositionAutomaton positions;
+            rule.nfaSeconds = Seconds([&] { positions = PostfixToPositions(postfix); });
+            if (BitNFA::Fits(positions)) {
+                rule.nfaSeconds += Seconds([&] {
+                    bitNFAs[i] = make_unique<BitNFA>(positions);
+                    if (!bitNFAs[i]->BlowsUp())
+                        bitNFAs[i].reset();
+                });
+            }
+            if (bitNFAs[i]) {
+                acceptsEmpty[i] = positions.nullable;
+                rule.nfaStates = bitNFAs[i]->NumPositions();
+                for (const vector<int>& follow : positions.follow)
+                    rule.nfaTransitions += follow.size();
+                return;
+            }
+        }
+        rule.nfaSeconds += Seconds([&] {
+            nfas[i] = options.glushkov ? PostfixToGlushkovNFA(postfix) : PostfixToNFA(postfix);
+        });
+        acceptsEmpty[i] = nfas[i].AcceptsEmpty();
+        rule.nfaStates = nfas[i].GetMaxLabel() + 1;
+        rule.nfaTransitions = nfas[i].NumTransitions();
+        rule.ntranBytes = nfas[i].NtranBytes();
+        // a lazy spec may be lazy because its DFA blows up, so never build one
+        if (options.stats && !options.lazy) {
+            const DFA own = nfas[i].NFA2DFA();
+            rule.dfaStates = own.NumStates();
+            rule.dfaTransitions = own.NumTransitions();
+            rule.dtranBytes = own.DtranBytes();
+        }
+    });
+    for (const RuleStats& rule : stats.rules) {
+        stats.parseSeconds += rule.parseSeconds;
+        stats.nfaSeconds += rule.nfaSeconds;
+    }
+
+    // every definition becomes one alternative of a single combined NFA,
+    // its final states tagged with the definition's index as priority
+    NFA combined;
+    combined.SetInitialState(combined.CreateNewState());
+    vector<size_t> dfaRules; // the definitions in combined, in priority order
+    for (size_t i = 0; i < definitions.size(); i++) {
+        if (malformed[i]) {
+            syntaxErrorTokens.push_back(definitions[i].first);
+            continue;
+        }
+        if(acceptsEmpty[i]) {
+            epsilonTokens.push_back(definitions[i].first);
             continue;  // if it has epsilon, don't add it
         }
 
-        tokenDFAs.emplace_back(tokenName, dfa);
+        if (bitNFAs[i]) {
+            bitRules.emplace_back(static_cast<int>(tokenNames.size()), std::move(*bitNFAs[i]));
+        } else {
+            nfas[i].TagFinalStates(static_cast<int>(tokenNames.size()));
+            combined.AddAlternative(nfas[i]);
+            dfaRules.push_back(i);
+        }
+        tokenNames.push_back(definitions[i].first);
     }
-    // if any epsilon tokens were detected, output errors and terminate
-    if(!errors.empty()){
-        cout << "EPSILON IS NOT A TOKEN ";
-        for(auto &e: errors)
-            cout << e << " ";
-        exit(1);  // stop the lexer from running
+    // if any epsilon or malformed tokens were detected the spec is unusable, the caller reports them
+    if(!IsUsable())
+        return;
+    // in lazy mode keep the NFA and determinize it while scanning, so a spec
+    // whose DFA blows up costs only the states the input actually reaches
+    stats.nfaStates = combined.GetMaxLabel() + 1;
+    stats.nfaTransitions = combined.NumTransitions();
+    stats.ntranBytes = combined.NtranBytes();
+    if (options.lazy) {
+        lazy = true;
+        nfa = combined.Flatten();
+    } else if (dfaRules.size() >= 2 * PartitionRules) {
+        // subset construction dominates compiling a large spec, so determinize
+        // fixed runs of definitions on the workers and run the partial DFAs side
+        // by side. the minimal DFA is unique and Minimize numbers it canonically,
+        // so the table is the same as determinizing combined in one go
+        vector<DFA> parts((dfaRules.size() + PartitionRules - 1) / PartitionRules);
+        stats.subsetSeconds = Seconds([&] {
+            ParallelFor(parts.size(), threads, [&](const size_t p) {
+                NFA part;
+                part.SetInitialState(part.CreateNewState());
+                for (size_t r = p * PartitionRules; r < min(dfaRules.size(), (p + 1) * PartitionRules); r++)
+                    part.AddAlternative(nfas[dfaRules[r]]);
+                parts[p] = part.NFA2DFA();
+                parts[p].Minimize();
+            });
+            dfa = DFA::Product(parts);
+        });
+        stats.minimizeSeconds = Seconds([&] { removedStates = dfa.Minimize(); });
+    } else {
+        // determinize all definitions together so getToken needs a single pass,
+        // then minimize so the scanned table stays small
+        stats.subsetSeconds = Seconds([&] { dfa = combined.NFA2DFA(); });
+        stats.minimizeSeconds = Seconds([&] { removedStates = dfa.Minimize(); });
+    }
+    FindStartBytes();
+}
+
+//--------------------------------------------------------------
+// the bytes the start state has a move on; any other byte is an
+// INVALID token by itself
+//--------------------------------------------------------------
+void LexerSpec::FindStartBytes() {
+    if (lazy) {
+        for (const int s : nfa.closure[nfa.init_state]) {
+            for (const auto& [sym, d] : nfa.moves[s])
+                startBytes.Add(static_cast<unsigned char>(sym));
+        }
+    } else {
+        for (int b = 0; b < 256; b++) {
+            if (dfa.Next(dfa.GetStartState(), static_cast<char>(b)) != -1)
+                startBytes.Add(static_cast<unsigned char>(b));
+        }
+    }
+    for (const auto& [token, rule] : bitRules) {
+        for (int b = 0; b < 256; b++) {
+            if (rule.CanStart(static_cast<unsigned char>(b)))
+                startBytes.Add(static_cast<unsigned char>(b));
+        }
+    }
+    for (int b = 0; b < 256; b++) {
+        if (startBytes.Contains(static_cast<unsigned char>(b)) || isspace(b))
+            runEnds.Add(static_cast<unsigned char>(b));
+    }
+}
+
+// state ids of an eager DFA never change; a lazy DFA renumbers them on every flush
+static size_t CacheEpoch(const DFA&) { return 0; }
+static size_t CacheEpoch(const LazyDFA& dfa) { return dfa.GetFlushCount(); }
+
+//--------------------------------------------------------------
+// run the automaton from pos and return the length of the longest
+// accepted prefix (0 if none), setting token to its definition index.
+// each accepting state already carries the earliest definition
+// matching that prefix.
+// in linear mode this is Reps' maximal munch: every (state, position)
+// passed after the last accept is remembered as a dead end once the
+// scan fails, and later scans stop as soon as they reach one, so no
+// input byte is scanned from the same state twice
+//--------------------------------------------------------------
+template <class Automaton>
+size_t Lexer::Match(Automaton& dfa, int& token) {
+    Matcher<Automaton> matcher(dfa);
+    const size_t epoch = CacheEpoch(dfa);
+    if (options.linear && epoch != failedEpoch) {
+        failed.clear();  // recorded under state ids that no longer exist
+        failedEpoch = epoch;
+    }
+    trail.clear();
+
+    // process input characters until fail; refilling may move the
+    // lexeme to the front of the buffer, so index it relative to pos
+    size_t steps = 0;
+    for (size_t length = 0; pos + length < input.size() || Refill(); length++) {
+        if (options.linear) {
+            const pair<size_t, int> key(consumed + pos + length, matcher.GetState());
+            if (failed.count(key))
+                break;
+            trail.push_back(key);
+        }
+        matcher.Move(input[pos + length]);
+        steps++;
+        if(matcher.GetStatus() == FAIL)
+            break;
+        // the matcher keeps the longest accepted lexeme
+        if(matcher.GetStatus() == ACCEPT)
+            trail.clear();
+    }
+    // nothing after the last accept led to another one
+    if (options.linear && CacheEpoch(dfa) == epoch)
+        failed.insert(trail.begin(), trail.end());
+    token = matcher.GetAcceptedToken();
+    // the lexeme (or the byte an INVALID token takes) is not scanned again
+    scanStats.steps += steps;
+    scanStats.rescanned += steps - min(steps, max<size_t>(matcher.GetAcceptedLength(), 1));
+    return matcher.GetAcceptedLength();
+}
+
+//--------------------------------------------------------------
+// the length of the longest prefix from pos a bit-parallel rule
+// accepts, 0 if none
+//--------------------------------------------------------------
+size_t Lexer::MatchBits(const BitNFA& rule) {
+    uint64_t active = rule.GetStartState();
+    size_t accepted = 0;
+    for (size_t length = 0; pos + length < input.size() || Refill(); length++) {
+        active = rule.Next(active, input[pos + length]);
+        scanStats.steps++;
+        if (!active)
+            break;
+        if (rule.IsAccepting(active))
+            accepted = length + 1;
     }
+    return accepted;
+}
+
+//--------------------------------------------------------------
+// streaming mode: read the next chunk. everything before pos has
+// been tokenized, so only the unfinished lexeme is carried over to
+// the front of the buffer. returns false at the end of the stream
+//--------------------------------------------------------------
+bool Lexer::Refill() {
+    if (!source || !*source)
+        return false;
+    consumed += pos;
+    buffer.erase(0, pos);
+    pos = 0;
+    // scans only go forward from here, so earlier dead ends are never looked up again
+    for (auto it = failed.begin(); it != failed.end();)
+        it = it->first < consumed ? failed.erase(it) : next(it);
+
+    const size_t carried = buffer.size();
+    buffer.resize(carried + options.chunkBytes);
+    source->read(&buffer[carried], static_cast<streamsize>(options.chunkBytes));
+    buffer.resize(carried + static_cast<size_t>(source->gcount()));
+    input = buffer;
+    return input.size() > carried;
 }
 
 Token Lexer::getToken() {
-    // skip whitespace
-    while (pos < input.size() && isspace(input[pos]))
-        pos++;
+    // skip whitespace a vector at a time, refilling until a token starts
+    while ((pos = SkipWhitespace(pos)) >= input.size() && Refill())
+        ;
     if (pos >= input.size())
-        return {"EOS", ""};
-
-    int bestLength = 0;
-    string bestToken;
-    string bestLexeme;
-
-    // simulate its DFA from the current input position
-    for(auto& tokenDef : tokenDFAs) {
-        const string tokenName = tokenDef.first;
-        DFA dfa = tokenDef.second; // work with a copy
-        dfa.Reset();
-        int currentPos = static_cast<int>(pos);
-        int acceptedLength = 0;
-        string acceptedLex;
-        // process input characters until fail
-        while (currentPos < input.size()) {
-            const char c = input[currentPos];
-            dfa.Move(c);
-            if(dfa.GetStatus() == FAIL)
-                break;
-            if(dfa.GetStatus() == ACCEPT) {
-                acceptedLength = currentPos - pos + 1;
-                acceptedLex = dfa.GetAcceptedLexeme();
+        return {};
+
+    // a byte no token starts with is INVALID by itself; find the end of the
+    // whole run of them at once so the rest of it bypasses the DFA
+    if (consumed + pos >= invalidUntil && !spec->CanStart(input[pos]))
+        invalidUntil = consumed + FindFirstOf(input, pos, spec->GetRunEnds());
+    int bestToken = -1;
+    size_t bestLength = 0;
+    if (consumed + pos >= invalidUntil) {
+        bestLength = lazyDFA ? Match(*lazyDFA, bestToken) : Match(spec->GetDFA(), bestToken);
+        for (const auto& [token, rule] : spec->GetBitRules()) {
+            if (!rule.CanStart(static_cast<unsigned char>(input[pos])))
+                continue;
+            // longest match wins, then the earliest definition
+            const size_t length = MatchBits(rule);
+            if (length > bestLength || (length == bestLength && length > 0 && token < bestToken)) {
+                bestLength = length;
+                bestToken = token;
             }
-            currentPos++;
-        }
-        // pick the token with the longest accepted lexeme
-        if(acceptedLength > bestLength) {
-            bestLength = acceptedLength;
-            bestToken = tokenName;
-            bestLexeme = acceptedLex;
         }
     }
+    const size_t start = pos;
 
     // if no token matches then return an INVALID token
+    scanStats.tokens++;
     if(bestLength == 0) {
-        string bad(1, input[pos]);
+        scanStats.invalid++;
         pos++;
-        return {"INVALID", bad};
+        return {Token::INVALID, "INVALID", input.substr(start, 1), consumed + start};
     }
 
     pos += bestLength;
-    return {bestToken, bestLexeme};
+    return {bestToken, spec->GetTokenName(bestToken), input.substr(start, bestLength), consumed + start};
+}
+
+size_t Lexer::SkipWhitespace(const size_t from) const {
+    return SkipSpaces(input, from);
+}
+
+//--------------------------------------------------------------
+// tokenize everything from pos to the end of the input, on up to
+// `threads` workers, handing the tokens to `write` a window at a
+// time so memory stays bounded however long the input is. a window
+// is up to threads * 4 chunks of parallelChunkBytes, each starting
+// right after whitespace, and every chunk is lexed speculatively as
+// if a token started there. the chunks are then stitched in order:
+// lexing is deterministic from a token start, so once the real
+// token stream reaches a start position a chunk also produced, the
+// rest of that chunk is exact. where a token crossed the cut, the
+// real stream is lexed sequentially until it lines up again. the
+// windows together are exactly the tokens of calling getToken
+// until EOS. a streamed lexeme is only valid until the next
+// getToken, so a stream is lexed sequentially and its tokens are
+// written one at a time
+//--------------------------------------------------------------
+void Lexer::TokenizeAll(const unsigned threads, const function<void(const vector<Token>&)>& write) {
+    vector<Token> tokens;
+    const size_t chunkBytes = max<size_t>(options.parallelChunkBytes, 1);
+    if (threads <= 1 || source) {
+        const size_t window = source ? 1 : sequentialWindow;
+        for (Token token = getToken(); token.id != Token::EOS; token = getToken()) {
+            tokens.push_back(token);
+            if (tokens.size() == window) {
+                write(tokens);
+                tokens.clear();
+            }
+        }
+        if (!tokens.empty())
+            write(tokens);
+        return;
+    }
+
+    const size_t end = input.size();
+    for (size_t begin = SkipWhitespace(pos); begin < end; begin = SkipWhitespace(pos)) {
+        // chunk boundaries: the first non-whitespace byte after a whitespace
+        // run at or past each nominal cut, or the end of the input if none
+        const size_t chunkCount = min<size_t>((end - begin + chunkBytes - 1) / chunkBytes, threads * 4);
+        vector<size_t> cuts{begin};
+        for (size_t k = 1; k <= chunkCount; k++) {
+            size_t cut = max(min(begin + k * chunkBytes, end), cuts.back());
+            while (cut < end && !isspace(static_cast<unsigned char>(input[cut])))
+                cut++;
+            cuts.push_back(SkipWhitespace(cut));
+        }
+
+        // lex every chunk speculatively, keeping the tokens that start inside it
+        vector<vector<Token>> speculative(chunkCount);
+        vector<ScanStats> workerStats(chunkCount);
+        ParallelFor(chunkCount, threads, [&](const size_t k) {
+            if (cuts[k] >= cuts[k + 1])
+                return;
+            Lexer worker(spec, input, cuts[k], options);
+            for (Token token = worker.getToken(); token.id != Token::EOS && token.offset < cuts[k + 1]; token = worker.getToken())
+                speculative[k].push_back(token);
+            workerStats[k] = worker.scanStats;
+        });
+        // speculative moves are work done too; tokens are counted as they are written
+        const ScanStats before = scanStats;
+        size_t written = 0;
+        size_t invalid = 0;
+        for (const ScanStats& worker : workerStats) {
+            scanStats.steps += worker.steps;
+            scanStats.rescanned += worker.rescanned;
+        }
+
+        // stitch: the first chunk starts at a real token boundary, the
+        // others are validated against the real stream. each chunk is
+        // written and freed as soon as it is stitched
+        for (size_t k = 0; k < chunkCount; k++) {
+            vector<Token> chunk = std::move(speculative[k]);
+            tokens.clear();
+            while (true) {
+                const size_t start = SkipWhitespace(pos);
+                if (start >= cuts[k + 1])
+                    break; // the real stream has moved past this chunk
+                const auto synced = lower_bound(chunk.begin(), chunk.end(), start,
+                    [](const Token& token, const size_t offset) { return token.offset < offset; });
+                if (synced != chunk.end() && synced->offset == start) {
+                    // in sync with the speculative tokens from here to the end of the chunk
+                    tokens.insert(tokens.end(), synced, chunk.end());
+                    pos = tokens.back().offset + tokens.back().lexeme.size();
+                    break;
+                }
+                // out of sync (a token crossed the cut), take one real token
+                tokens.push_back(getToken());
+            }
+            // getToken counted the out of sync tokens already, so recount from the window start
+            written += tokens.size();
+            invalid += count_if(tokens.begin(), tokens.end(),
+                [](const Token& token) { return token.id == Token::INVALID; });
+            scanStats.tokens = before.tokens + written;
+            scanStats.invalid = before.invalid + invalid;
+            if (!tokens.empty())
+                write(tokens);
+        }
+    }
+    pos = max(pos, SkipWhitespace(pos));
+}
+
+ScanStats Lexer::GetStats() const {
+    ScanStats stats = scanStats;
+    stats.bytes = consumed + pos;
+    if (lazyDFA) {
+        stats.lazyStates = lazyDFA->NumStates();
+        stats.lazyFlushes = lazyDFA->GetFlushCount();
+    }
+    return stats;
+}
+
+// the bench target builds this file without the command line driver
+#ifndef LEXER_NO_MAIN
+
+//--------------------------------------------------------------
+// --stats report, on stderr so the token output is unchanged
+//--------------------------------------------------------------
+static void PrintStats(const LexerSpec& spec, const double compileSeconds, const ScanStats& scan, const double scanSeconds) {
+    const CompileStats& compile = spec.GetStats();
+    const auto ms = [](const double seconds) { return to_string(seconds * 1e3) + " ms"; };
+    cerr << "compile: " << ms(compileSeconds) << (compile.rules.empty() ? " (loaded)" : "") << "\n";
+    if (!compile.rules.empty()) {
+        cerr << "  regex parsing     " << ms(compile.parseSeconds) << "\n"
+             << (compile.glushkov ? "  glushkov          " : "  thompson          ") << ms(compile.nfaSeconds) << "\n";
+        if (!spec.IsLazy()) {
+            cerr << "  subset            " << ms(compile.subsetSeconds) << "\n"
+                 << "  minimization      " << ms(compile.minimizeSeconds) << "\n";
+        }
+        cerr << "rules: name, nfa states/transitions/Ntran bytes, dfa states/transitions/Dtran bytes\n";
+        for (const RuleStats& rule : compile.rules) {
+            cerr << "  " << rule.name << " " << rule.nfaStates << "/" << rule.nfaTransitions << "/" << rule.ntranBytes
+                 << " " << (rule.dfaStates < 0 ? string("n/a") : to_string(rule.dfaStates) + "/"
+                            + to_string(rule.dfaTransitions) + "/" + to_string(rule.dtranBytes)) << "\n";
+        }
+        cerr << "combined nfa: " << compile.nfaStates << " states, " << compile.nfaTransitions
+             << " transitions, ~" << compile.ntranBytes << " Ntran bytes\n";
+    }
+    if (!spec.GetBitRules().empty())
+        cerr << "bit-parallel rules: " << spec.GetBitRules().size() << " (the rest are in the automaton below)\n";
+    if (spec.IsLazy()) {
+        cerr << "lazy dfa: " << scan.lazyStates << " states cached, " << scan.lazyFlushes << " flushes\n";
+    } else {
+        const DFA& dfa = spec.GetDFA();
+        cerr << "combined dfa: " << dfa.NumStates() << " states (" << spec.GetRemovedStates() << " merged), "
+             << dfa.NumClasses() << " byte classes, " << dfa.NumTransitions() << " transitions, ~"
+             << dfa.DtranBytes() << " Dtran bytes, " << dfa.TableBytes() << " table bytes\n";
+    }
+    const double seconds = max(scanSeconds, 1e-9);
+    cerr << "scan: " << ms(scanSeconds) << ", " << scan.bytes << " bytes (" << scan.bytes / 1e6 / seconds
+         << " MB/s), " << scan.tokens << " tokens (" << scan.tokens / seconds << "/s), "
+         << scan.invalid << " INVALID\n"
+         << "  dfa steps " << scan.steps << ", bytes rescanned by backtracking " << scan.rescanned << "\n";
 }
 
-int main() {
+//--------------------------------------------------------------
+// batch mode: a stream of records, each a definition line (ending
+// in '#') followed by any number of input lines. every input's
+// tokens are followed by an empty line. specs are compiled once and
+// kept in an LRU cache, so a repeated record costs only its scans
+//--------------------------------------------------------------
+static int RunBatch(istream& in, const LexerOptions& options, const size_t cacheSpecs, TokenWriter& writer, const bool binary) {
+    SpecCache cache(cacheSpecs, options);
+    shared_ptr<const LexerSpec> spec;
+    string line;
+    while (getline(in, line)) {
+        const size_t last = line.find_last_not_of(" \t");
+        if (last == string::npos)
+            continue; // blank lines may separate records
+        if (line[last] == '#') {
+            spec = cache.Get(line);
+            if (!spec->IsUsable()) {
+                if (binary)
+                    cerr << SpecError(*spec) << endl;
+                else
+                    writer.WriteText(SpecError(*spec) + "\n");
+            }
+            continue;
+        }
+        if (!spec) {
+            cerr << "input before any token definitions" << endl;
+            return 1;
+        }
+        // remove surrounding quotes if present
+        if(line.size() >= 2 && line.front() == '"' && line.back() == '"')
+            line = line.substr(1, line.size()-2);
+        if (spec->IsUsable()) {
+            Lexer lexer(spec, line, options);
+            writer.Begin(*spec);
+            for (Token token = lexer.getToken(); token.id != Token::EOS; token = lexer.getToken())
+                writer.Write(token);
+            writer.End(lexer.GetStats().bytes);
+        }
+        if (!binary)
+            writer.WriteText("\n");
+        // a client waiting on this input gets its answer now
+        if (!writer.Flush())
+            return 1;
+    }
+    if (options.stats) {
+        cerr << "spec cache: " << cache.GetHits() << " hits, " << cache.GetMisses() << " misses, "
+             << cache.Size() << " held\n";
+    }
+    return 0;
+}
+
+//--------------------------------------------------------------
+// --edits: lex the input line once, then apply each edit that
+// follows it and print the tokens after every one; only the
+// tokens around an edit are lexed again
+//--------------------------------------------------------------
+static int RunEdits(istream& in, shared_ptr<const LexerSpec> spec, const LexerOptions& options, TokenWriter& writer, const bool binary) {
+    string line;
+    getline(in, line);
+    // remove surrounding quotes if present
+    if(line.size() >= 2 && line.front() == '"' && line.back() == '"')
+        line = line.substr(1, line.size()-2);
+    IncrementalLexer document(spec, line, options);
+    const auto writeTokens = [&] {
+        writer.Begin(*spec);
+        for (const Token& token : document.GetTokens())
+            writer.Write(token);
+        writer.End(document.GetText().size());
+        if (!binary)
+            writer.WriteText("\n");
+        return writer.Flush();
+    };
+    if (!writeTokens())
+        return 1;
+    size_t edits = 0;
+    size_t relexed = 0;
+    while (getline(in, line)) {
+        if (line.find_first_not_of(" \t") == string::npos)
+            continue;
+        istringstream fields(line);
+        size_t offset, removed;
+        string inserted;
+        if (!(fields >> offset >> removed)) {
+            cerr << "bad edit " << line << endl;
+            return 1;
+        }
+        // Edit would clamp it, but an edit past the end is a mistake in the input
+        const size_t size = document.GetText().size();
+        if (offset > size || removed > size - offset) {
+            cerr << "edit out of range " << line << " (the text is " << size << " bytes)" << endl;
+            return 1;
+        }
+        getline(fields >> ws, inserted);
+        if(inserted.size() >= 2 && inserted.front() == '"' && inserted.back() == '"')
+            inserted = inserted.substr(1, inserted.size()-2);
+        relexed += document.Edit(offset, removed, inserted);
+        edits++;
+        if (!writeTokens())
+            return 1;
+    }
+    if (options.stats)
+        cerr << "edits: " << edits << " edits, " << relexed << " tokens lexed again\n";
+    return 0;
+}
+
+//--------------------------------------------------------------
+// printed for --help, and on stderr for a bad option
+//--------------------------------------------------------------
+static const char* const Usage = R"(usage: ./a.out [options] < charstream.txt > output.txt
+Options:
+    --lazy               build DFA states on demand while scanning
+    --cache-bytes N      memory budget of the lazy DFA cache (default 8 MB)
+    --linear             guarantee linear-time longest match by memoizing dead ends
+    --input FILE         lex FILE (memory-mapped) instead of the second line
+    --stream             read the input in chunks (the rest of stdin, or the --input
+                         file) instead of holding it in memory
+    --chunk-bytes N      chunk size for --stream (default 64 KB)
+    --threads N          tokenize the input on N threads (not with --stream)
+    --compile-threads N  compile token definitions on N threads (default: all cores)
+    --save FILE          write the compiled token definitions to FILE
+    --load FILE          use token definitions compiled by --save; the
+                         definition line is then left out of the input
+    --spec FILE          read the definition line from FILE instead of stdin
+    --generate PREFIX    write a direct-coded scanner for the definitions to
+                         PREFIX.h and PREFIX.cpp, then exit
+    --parallel-chunk-bytes N
+                         smallest input piece given to one thread (default 1 MB)
+    --bit-parallel       simulate rules of up to 63 symbols whose DFA would
+                         blow up bit-parallel instead of determinizing them
+    --glushkov           build position automata (no epsilon moves) instead
+                         of Thompson NFAs
+    --stats              report phase timings, automaton sizes and scan
+                         counters on stderr
+    --batch              read records from stdin until EOF: a definition line
+                         (ending in '#'), then any number of quoted input
+                         lines, each answered by its tokens and an empty line
+    --cache-specs N      compiled specs kept by --batch (default 64)
+    --edits              edit the input line incrementally: every following
+                         line is an edit OFFSET REMOVED "TEXT", answered by
+                         the whole token stream and an empty line (as is
+                         the input line itself). an edit that reaches past
+                         the end of the text is an error
+    --binary             write tokens as binary records (see TokenWriter.h)
+                         instead of name , "lexeme" lines
+    --help               print this text and exit
+In --input and --stream mode the input is raw text, not a quoted string.
+)";
+
+static int BadOption(const string& problem) {
+    cerr << problem << "\n" << Usage;
+    return 1;
+}
+
+int main(int argc, char* argv[]) {
     ios::sync_with_stdio(false);
     cin.tie(nullptr);
 
-    // read the token definitions (first line)
-    string tokenDefs;
-    getline(cin, tokenDefs);
+    LexerOptions options;
+    string inputFile;
+    bool stream = false;
+    unsigned threads = 1;
+    string saveFile, loadFile, specFile, generatePrefix;
+    bool batch = false;
+    bool binary = false;
+    bool edits = false;
+    size_t cacheSpecs = 64;
+    for (int i = 1; i < argc; i++) {
+        const string arg = argv[i];
+        if (arg == "--lazy") {
+            options.lazy = true;
+        } else if (arg == "--cache-bytes" && i + 1 < argc) {
+            if (!ParseCount(argv[++i], options.lazyCacheBytes))
+                return BadOption("bad value " + string(argv[i]) + " for " + arg);
+        } else if (arg == "--linear") {
+            options.linear = true;
+        } else if (arg == "--input" && i + 1 < argc) {
+            inputFile = argv[++i];
+        } else if (arg == "--stream") {
+            stream = true;
+        } else if (arg == "--chunk-bytes" && i + 1 < argc) {
+            if (!ParseCount(argv[++i], options.chunkBytes))
+                return BadOption("bad value " + string(argv[i]) + " for " + arg);
+            options.chunkBytes = max<size_t>(1, options.chunkBytes);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            if (!ParseCount(argv[++i], threads))
+                return BadOption("bad value " + string(argv[i]) + " for " + arg);
+        } else if (arg == "--save" && i + 1 < argc) {
+            saveFile = argv[++i];
+        } else if (arg == "--load" && i + 1 < argc) {
+            loadFile = argv[++i];
+        } else if (arg == "--spec" && i + 1 < argc) {
+            specFile = argv[++i];
+        } else if (arg == "--generate" && i + 1 < argc) {
+            generatePrefix = argv[++i];
+        } else if (arg == "--compile-threads" && i + 1 < argc) {
+            if (!ParseCount(argv[++i], options.compileThreads))
+                return BadOption("bad value " + string(argv[i]) + " for " + arg);
+        } else if (arg == "--batch") {
+            batch = true;
+        } else if (arg == "--cache-specs" && i + 1 < argc) {
+            if (!ParseCount(argv[++i], cacheSpecs))
+                return BadOption("bad value " + string(argv[i]) + " for " + arg);
+        } else if (arg == "--edits") {
+            edits = true;
+        } else if (arg == "--binary") {
+            binary = true;
+        } else if (arg == "--bit-parallel") {
+            options.bitParallel = true;
+        } else if (arg == "--glushkov") {
+            options.glushkov = true;
+        } else if (arg == "--stats") {
+            options.stats = true;
+        } else if (arg == "--parallel-chunk-bytes" && i + 1 < argc) {
+            if (!ParseCount(argv[++i], options.parallelChunkBytes))
+                return BadOption("bad value " + string(argv[i]) + " for " + arg);
+            options.parallelChunkBytes = max<size_t>(1, options.parallelChunkBytes);
+        } else if (arg == "--help") {
+            cout << Usage;
+            return 0;
+        } else {
+            return BadOption("unknown option " + arg);
+        }
+    }
 
-    // read the input string (next line)
-    string inputLine;
-    getline(cin, inputLine);
-    // remove surrounding quotes if present
-    if(!inputLine.empty() && inputLine.front() == '"' && inputLine.back() == '"')
-        inputLine = inputLine.substr(1, inputLine.size()-2);
+    // tokens go to stdout through one buffer, bypassing cout
+    TokenWriter writer(STDOUT_FILENO, binary ? TokenWriter::BINARY : TokenWriter::TEXT);
+    if (batch)
+        return RunBatch(cin, options, cacheSpecs, writer, binary);
 
-    // create the lexer with the token definitions and input string
-    Lexer lexer(tokenDefs, inputLine);
+    // load the compiled token definitions, or read them (first line) and compile them once
+    const auto compileBegin = chrono::steady_clock::now();
+    shared_ptr<const LexerSpec> spec;
+    if (!loadFile.empty()) {
+        string error;
+        if (!(spec = LexerSpec::Load(loadFile, error))) {
+            cerr << error << endl;
+            return 1;
+        }
+    } else {
+        string tokenDefs;
+        if (specFile.empty()) {
+            getline(cin, tokenDefs);
+        } else {
+            ifstream defs(specFile);
+            if (!getline(defs, tokenDefs)) {
+                cerr << "cannot read " << specFile << endl;
+                return 1;
+            }
+        }
+        spec = make_shared<const LexerSpec>(tokenDefs, options);
+        if (!spec->IsUsable()) {
+            cout << SpecError(*spec);
+            return 1;  // stop the lexer from running
+        }
+    }
+    const double compileSeconds = chrono::duration<double>(chrono::steady_clock::now() - compileBegin).count();
+    if (!saveFile.empty()) {
+        if (string error; !spec->Save(saveFile, error)) {
+            cerr << error << endl;
+            return 1;
+        }
+    }
+    if (!generatePrefix.empty()) {
+        string error;
+        if (!GenerateScanner(*spec, generatePrefix, error)) {
+            cerr << error << endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (edits)
+        return RunEdits(cin, spec, options, writer, binary);
+
+    // create the lexer over the input
+    ifstream file;
+    unique_ptr<MappedFile> mapped;
+    unique_ptr<Lexer> lexer;
+    if (stream) {
+        // tokens are produced while the rest of the stream is still unread
+        if (!inputFile.empty())
+            file.open(inputFile, ios::binary);
+        if (!inputFile.empty() && !file) {
+            cerr << "cannot open " << inputFile << endl;
+            return 1;
+        }
+        lexer = make_unique<Lexer>(spec, inputFile.empty() ? cin : file, options);
+    } else if (!inputFile.empty()) {
+        // tokens are views straight into the mapping
+        mapped = make_unique<MappedFile>(inputFile);
+        if (!mapped->IsOpen()) {
+            cerr << "cannot open " << inputFile << endl;
+            return 1;
+        }
+        lexer = make_unique<Lexer>(spec, *mapped, options);
+    } else {
+        // read the input string (next line)
+        string inputLine;
+        getline(cin, inputLine);
+        // remove surrounding quotes if present
+        if(!inputLine.empty() && inputLine.front() == '"' && inputLine.back() == '"')
+            inputLine = inputLine.substr(1, inputLine.size()-2);
+        lexer = make_unique<Lexer>(spec, inputLine, options);
+    }
 
     // get tokens until EOS and print them
-    Token token;
-    while ((token = lexer.getToken()).tokenName != "EOS") {
-        cout << token.tokenName << " , \"" << token.lexeme << "\"" << "\n";
+    const auto scanBegin = chrono::steady_clock::now();
+    writer.Begin(*spec);
+    lexer->TokenizeAll(threads, [&](const vector<Token>& tokens) {
+        for (const Token& token : tokens)
+            writer.Write(token);
+    });
+    writer.End(lexer->GetStats().bytes);
+    if (!writer.Flush()) {
+        cerr << "cannot write the tokens" << endl;
+        return 1;
+    }
+    if (options.stats) {
+        PrintStats(*spec, compileSeconds, lexer->GetStats(),
+                   chrono::duration<double>(chrono::steady_clock::now() - scanBegin).count());
     }
 
     return 0;
-}
\ No newline at end of file
+}
+#endif
@@ -2,30 +2,202 @@
 #define LEXER_H
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <memory>
+#include <functional>
+#include <istream>
+#include <unordered_set>
+#include <cstdint>
 #include "DFA.h"
+#include "LazyDFA.h"
+#include "MappedFile.h"
+#include "ByteScan.h"
+#include "BitNFA.h"
 
+//--------------------------------------------------------------
+// a token refers into the lexer instead of owning strings: its name
+// is the lexer's interned definition name and its lexeme is a view
+// of the input. both stay valid while the lexer lives (in streaming
+// mode the lexeme only until the next getToken call)
+//--------------------------------------------------------------
 class Token {
 public:
-    Token(string t, string l) : tokenName(t), lexeme(l) {}
-    Token() : tokenName("EOS"), lexeme("") {}
+    static constexpr int EOS = -1;
+    static constexpr int INVALID = -2;
+
+    Token(int i, string_view t, string_view l, size_t o) : id(i), tokenName(t), lexeme(l), offset(o) {}
+    Token() : id(EOS), tokenName("EOS"), lexeme(), offset(0) {}
+
+    int id;               // definition index, or EOS / INVALID
+    string_view tokenName;
+    string_view lexeme;
+    size_t offset;        // position of the lexeme in the input
+};
+
+//--------------------------------------------------------------
+// how the token definitions are compiled and scanned
+//--------------------------------------------------------------
+struct LexerOptions {
+    bool lazy = false;                // build DFA states on demand instead of up front
+    size_t lazyCacheBytes = 8 << 20;  // memory budget of the lazy DFA's state cache
+    bool linear = false;              // memoize failed (state, position) pairs so scanning is O(n)
+    size_t chunkBytes = 64 << 10;     // bytes read per refill when lexing a stream
+    size_t parallelChunkBytes = 1 << 20; // smallest piece TokenizeAll hands to a worker
+    unsigned compileThreads = 0;      // workers compiling token definitions, 0 for one per core
+    bool stats = false;               // also build each definition's own DFA to report its size
+    bool glushkov = false;            // build epsilon-free position automata instead of Thompson NFAs
+    bool bitParallel = false;         // simulate rules of up to 63 symbols whose DFA blows up bit-parallel, determinize the rest
+};
+
+//--------------------------------------------------------------
+// sizes and timings recorded while compiling a spec. times of the
+// per-definition phases are summed over definitions, which may be
+// compiled in parallel
+//--------------------------------------------------------------
+struct RuleStats {
+    string name;
+    double parseSeconds = 0;    // regex to postfix
+    double nfaSeconds = 0;      // postfix to NFA
+    int nfaStates = 0;
+    size_t nfaTransitions = 0;
+    size_t ntranBytes = 0;
+    int dfaStates = -1;         // the definition's own DFA, only with options.stats and not lazy (-1: not built)
+    size_t dfaTransitions = 0;
+    size_t dtranBytes = 0;
+};
+
+struct CompileStats {
+    vector<RuleStats> rules;
+    double parseSeconds = 0;
+    double nfaSeconds = 0;
+    bool glushkov = false;      // NFAs built as position automata rather than by Thompson
+    double subsetSeconds = 0;   // determinizing the combined NFA
+    double minimizeSeconds = 0;
+    int nfaStates = 0;          // the combined NFA
+    size_t nfaTransitions = 0;
+    size_t ntranBytes = 0;
+};
+
+//--------------------------------------------------------------
+// work done by one lexer
+//--------------------------------------------------------------
+struct ScanStats {
+    size_t bytes = 0;     // input consumed
+    size_t tokens = 0;
+    size_t invalid = 0;
+    size_t steps = 0;     // automaton moves
+    size_t rescanned = 0; // bytes scanned past the accepted lexeme, so scanned again for the next token
+    int lazyStates = 0;   // lazy mode: states cached, and times the cache was flushed
+    size_t lazyFlushes = 0;
+};
+
+//--------------------------------------------------------------
+// a compiled token specification: the definitions are compiled
+// together into one DFA whose accepting states carry the index of
+// the definition they belong to (or, in lazy mode, into one flat
+// NFA determinized while scanning). immutable once built, so one
+// spec can be shared by any number of lexers on any threads.
+// definitions that accept the empty string are listed by
+// GetEpsilonTokens, malformed ones by GetSyntaxErrorTokens, and a
+// spec with any of either must not be used (see IsUsable)
+//--------------------------------------------------------------
+class LexerSpec {
+public:
+    explicit LexerSpec(const string& tokenDefs, const LexerOptions& options = LexerOptions());
+    static string Normalize(const string& tokenDefs);
+    LexerSpec(const LexerSpec&) = delete;
+    LexerSpec& operator=(const LexerSpec&) = delete;
+
+    // compiled-lexer files: Save needs an eagerly compiled spec, Load returns
+    // nullptr and sets error if the file is missing, foreign, or corrupt
+    bool Save(const string& path, string& error) const;
+    static shared_ptr<const LexerSpec> Load(const string& path, string& error);
 
-    string tokenName;
-    string lexeme;
+    int NumTokens() const { return static_cast<int>(tokenNames.size()); }
+    const string& GetTokenName(int id) const { return tokenNames[id]; }
+    bool IsLazy() const { return lazy; }
+    const DFA& GetDFA() const { return dfa; }
+    const FlatNFA& GetNFA() const { return nfa; }
+    int GetRemovedStates() const { return removedStates; } // states merged away by minimization
+    const CompileStats& GetStats() const { return stats; } // empty for a loaded spec
+    const vector<string>& GetEpsilonTokens() const { return epsilonTokens; }
+    const vector<string>& GetSyntaxErrorTokens() const { return syntaxErrorTokens; }
+    bool IsUsable() const { return epsilonTokens.empty() && syntaxErrorTokens.empty(); }
+    const vector<pair<int, BitNFA>>& GetBitRules() const { return bitRules; } // (token, rule) outside the DFA
+    bool CanStart(char c) const { return startBytes.Contains(static_cast<unsigned char>(c)); }
+    const ByteSet& GetRunEnds() const { return runEnds; } // whitespace or a byte that can start a token
+private:
+    static constexpr size_t PartitionRules = 16; // definitions determinized together on one worker
+
+    LexerSpec() = default;
+    void FindStartBytes();
+
+    vector<string> tokenNames; // token names in definition order, interned once
+    DFA dfa;
+    FlatNFA nfa; // lazy mode only
+    bool lazy = false;
+    int removedStates = 0;
+    ByteSet startBytes; // first bytes of every token
+    ByteSet runEnds;
+    CompileStats stats;
+    vector<string> epsilonTokens;
+    vector<string> syntaxErrorTokens;
+    vector<pair<int, BitNFA>> bitRules;
 };
 
 //--------------------------------------------------------------
-// reads a token definition string and an input string
-// token definitions are stored in order as a vector of (token name, DFA)
+// scans one input against a shared compiled spec; holds only the
+// per-scan state (input position, lazy DFA cache, linear memo)
 //--------------------------------------------------------------
 class Lexer {
 public:
-    Lexer(const string& tokenDefs, const string& input);
+    Lexer(shared_ptr<const LexerSpec> spec, const string& input, const LexerOptions& options = LexerOptions());
+    Lexer(shared_ptr<const LexerSpec> spec, istream& source, const LexerOptions& options = LexerOptions());
+    Lexer(shared_ptr<const LexerSpec> spec, const MappedFile& file, const LexerOptions& options = LexerOptions());
+    // compile a private spec from a token definition string
+    Lexer(const string& tokenDefs, const string& input, const LexerOptions& options = LexerOptions());
+    Lexer(const Lexer&) = delete; // input may be a view of our own buffer
+    Lexer& operator=(const Lexer&) = delete;
     Token getToken();
+    void TokenizeAll(unsigned threads, const function<void(const vector<Token>&)>& write);
+    const LexerSpec& GetSpec() const { return *spec; }
+    ScanStats GetStats() const;
 private:
-    string input;
-    size_t pos;
-    vector<pair<string, DFA>> tokenDFAs;
+    friend class IncrementalLexer; // lexes from a position and reads the scan counters
+    Lexer(shared_ptr<const LexerSpec> spec, const LexerOptions& options);
+    Lexer(shared_ptr<const LexerSpec> spec, string_view text, size_t start, const LexerOptions& options);
+    size_t SkipWhitespace(size_t from) const;
+    bool Refill();
+    template <class Automaton>
+    size_t Match(Automaton& dfa, int& token);
+    size_t MatchBits(const BitNFA& rule);
+
+    shared_ptr<const LexerSpec> spec;
+    LexerOptions options;
+    unique_ptr<LazyDFA> lazyDFA; // this lexer's state cache in lazy mode
+
+    string buffer;     // owned input text: a copy of the input string, or the stream buffer
+    string_view input; // the text being lexed: buffer, or a mapped file
+    size_t pos = 0;
+    size_t invalidUntil = 0; // end of the current run of bytes no token starts with, as an offset
+
+    // streaming mode: buffer holds the unfinished lexeme plus the last chunk read from source
+    istream* source = nullptr;
+    size_t consumed = 0; // bytes dropped from the front of the buffer so far
+
+    // linear mode: (position, state) pairs from which no accepting state can be reached
+    struct ScanPointHash {
+        size_t operator()(const pair<size_t, int>& point) const {
+            return static_cast<size_t>((point.first * 0x9E3779B97F4A7C15ull) ^ static_cast<uint32_t>(point.second));
+        }
+    };
+    unordered_set<pair<size_t, int>, ScanPointHash> failed;
+    vector<pair<size_t, int>> trail; // pairs passed since the last accept in the current scan
+    size_t failedEpoch = 0; // lazy DFA flush count the memo was recorded under
+
+    ScanStats scanStats;
+    static constexpr size_t sequentialWindow = 1 << 16; // tokens TokenizeAll writes at once on one thread
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,35 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+//---------------------------------------------------------------------------------
+// run body(i) for every i in [0, count) on a pool of up to `threads` workers.
+// workers take the next index from a shared counter, so uneven items balance
+// out; returns once every item is done. threads <= 1 runs inline
+//---------------------------------------------------------------------------------
+template <class Body>
+void ParallelFor(const size_t count, const unsigned threads, Body&& body) {
+    const size_t workers = std::min<size_t>(threads, count);
+    if (workers <= 1) {
+        for (size_t i = 0; i < count; i++)
+            body(i);
+        return;
+    }
+    std::atomic<size_t> next{0};
+    auto work = [&]() {
+        for (size_t i = next++; i < count; i = next++)
+            body(i);
+    };
+    std::vector<std::thread> pool;
+    for (size_t w = 1; w < workers; w++)
+        pool.emplace_back(work);
+    work(); // the calling thread is a worker too
+    for (auto& t : pool)
+        t.join();
+}
+
+#endif
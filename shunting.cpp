@@ -6,8 +6,13 @@ shunting.cpp // POSTFIX
 #include <iostream>
 #include <stack>
 #include <string>
+#include <vector>
 #include <cctype>
+#include <map>
+#include <tuple>
+#include <algorithm>
 #include "NFA.h"
+#include "shunting.h"
 
 using namespace std;
 
@@ -25,20 +30,59 @@ int Precedence(const char op) {
 // check if a character is an operand (alpha)
 //---------------------------------------------------------------------
 bool IsOperand(const char c) {
-    return isalpha(c);
+    // the bytes of a UTF-8 character are negative chars, which isalpha must not see
+    return isalpha(static_cast<unsigned char>(c));
 }
 
 //---------------------------------------------------------------------
-// convert an infix regular expression to postfix
+// convert an infix regular expression to postfix. a class "[...]" and a
+// UTF-8 character outside one are both operands; they are written to the
+// postfix as one class, the character as "[c]".
+// returns an empty string if the regex is malformed: an operator short of
+// operands, an unmatched parenthesis, operands with no operator between
+// them, or a class without its ']' or without a character ([0-9] has
+// none, as digits are not operands)
 //---------------------------------------------------------------------
 string InfixToPostfix(const string& infix) {
     stack<char> ops;        // stack for operators
     string postfix;    // resulting postfix expression 'queue'
+    size_t operands = 0;    // depth of the operand stack evaluating the postfix would use
+    bool malformed = false;
 
-    for (char c : infix) {
+    // put an operator on the output queue, where it takes its operands
+    const auto outputOp = [&](const char op) {
+        const size_t needed = op == '*' ? 1 : 2;
+        if (op == '(' || operands < needed)
+            malformed = true; // a '(' is only output when it was never closed
+        else
+            operands -= needed - 1;
+        postfix += op;
+    };
+
+    for (size_t i = 0; i < infix.size() && !malformed; i++) {
+        const char c = infix[i];
         if (IsOperand(c)) {
             // if c is an operand, put it on the output queue
             postfix += c;
+            operands++;
+        }
+        else if (c == '[') {
+            // a class goes to the output queue whole
+            const size_t end = infix.find(']', i);
+            if (end == string::npos || ClassSequences(infix.substr(i + 1, end - i - 1)).empty())
+                return string();
+            postfix += infix.substr(i, end - i + 1);
+            operands++;
+            i = end;
+        }
+        else if (static_cast<unsigned char>(c) >= 0x80) {
+            // a UTF-8 character: its lead byte and continuation bytes
+            size_t end = i + 1;
+            while (end < infix.size() && (static_cast<unsigned char>(infix[end]) & 0xC0) == 0x80)
+                end++;
+            postfix += "[" + infix.substr(i, end - i) + "]";
+            operands++;
+            i = end - 1;
         }
         else if (c == '(' || c == '*') {
             // since * is a postfix operator we can simply push it (it will be popped immediately when lower precedence is encountered)
@@ -48,14 +92,16 @@ string InfixToPostfix(const string& infix) {
         else if (c == ')') {
             // pop off the stack until matching '(' is found
             while (!ops.empty() && ops.top() != '(') {
-                postfix += ops.top();
+                outputOp(ops.top());
                 ops.pop();
             }
+            if (ops.empty())
+                return string();  // no '(' to match
             ops.pop();  // pop the '('
         }
         else if (c == '|' || c == '.') {
             while (!ops.empty() && ops.top() != '(' && Precedence(ops.top()) >= Precedence(c)) {
-                postfix += ops.top();
+                outputOp(ops.top());
                 ops.pop();
             }
             ops.push(c);
@@ -63,52 +109,170 @@ string InfixToPostfix(const string& infix) {
     }
 
     // pop all remaining operators off the stack
-    while (!ops.empty()) {
-        postfix += ops.top();
+    while (!ops.empty() && !malformed) {
+        outputOp(ops.top());
         ops.pop();
     }
 
+    // a well-formed regex leaves exactly one operand, the whole expression
+    if (malformed || operands != 1)
+        return string();
     return postfix;
 }
 
+//---------------------------------------------------------------------
+// the byte sequences of the class at postfix[i], leaving i on its ']'
+//---------------------------------------------------------------------
+static vector<ByteSequence> ReadClass(const string& postfix, size_t& i) {
+    const size_t end = postfix.find(']', i);
+    const string body = postfix.substr(i + 1, end - i - 1);
+    i = end;
+    return ClassSequences(body);
+}
 
 //---------------------------------------------------------------------
-// convert a regular expression in postfix to an NFA using Thompson
+// convert a regular expression in postfix to an NFA using Thompson.
+// every fragment lives in the one nfa being built, so the stack only
+// holds (start, final) handles and each operator adds O(1) edges
 //---------------------------------------------------------------------
 NFA PostfixToNFA(const string& postfix) {
-    stack<NFA> nfa_stack;
-
-    for (char c : postfix) {
-        if (isalpha(c)) {
-            NFA fragment;
-            int s0 = fragment.CreateNewState();
-            int s1 = fragment.CreateNewState();
-            fragment.SetInitialState(s0);
-            fragment.SetFinalState(s1);
-            fragment.AddTransition(s0, {s1}, c);
-            fragment.AddSymbol(c);
-            nfa_stack.push(fragment);
+    NFA nfa;
+    stack<NFAFragment> fragments;
+
+    for (size_t i = 0; i < postfix.size(); i++) {
+        const char c = postfix[i];
+        if (IsOperand(c)) {
+            fragments.push(nfa.SymbolFragment(c));
+        } else if (c == '[') {
+            fragments.push(nfa.ClassFragment(ReadClass(postfix, i)));
         } else if (c == '*') {
-            NFA top = nfa_stack.top();
-            nfa_stack.pop();
-            top.Kleene();
-            nfa_stack.push(top);
+            const NFAFragment top = fragments.top();
+            fragments.pop();
+            fragments.push(nfa.KleeneFragment(top));
         } else if (c == '.') {
-            NFA b = nfa_stack.top();
-            nfa_stack.pop();
-            NFA a = nfa_stack.top();
-            nfa_stack.pop();
-            a.Concat(b);
-            nfa_stack.push(a);
+            const NFAFragment b = fragments.top();
+            fragments.pop();
+            const NFAFragment a = fragments.top();
+            fragments.pop();
+            fragments.push(nfa.ConcatFragments(a, b));
         } else if (c == '|') {
-            NFA b = nfa_stack.top();
-            nfa_stack.pop();
-            NFA a = nfa_stack.top();
-            nfa_stack.pop();
-            a.Union(b);
-            nfa_stack.push(a);
+            const NFAFragment b = fragments.top();
+            fragments.pop();
+            const NFAFragment a = fragments.top();
+            fragments.pop();
+            fragments.push(nfa.UnionFragments(a, b));
+        }
+    }
+
+    nfa.SetInitialState(fragments.top().start);
+    nfa.SetFinalState(fragments.top().final);
+    return nfa;
+}
+
+//---------------------------------------------------------------------
+// Glushkov's position automaton of a postfix regex: position 0 is the
+// initial state and every symbol occurrence is one more position,
+// entered only on its own symbol. the nullable, first, last and follow
+// sets are computed bottom-up from the postfix
+//---------------------------------------------------------------------
+struct PositionSets {
+    bool nullable;
+    vector<int> first;
+    vector<int> last;
+};
+
+PositionAutomaton PostfixToPositions(const string& postfix) {
+    PositionAutomaton positions;
+    positions.symbol = {{0, 0}};
+    positions.follow = {{}};
+    vector<vector<int>>& follow = positions.follow;
+    stack<PositionSets> sets;
+    const auto newPosition = [&](const ByteRange range) {
+        positions.symbol.push_back(range);
+        follow.emplace_back();
+        return static_cast<int>(positions.symbol.size()) - 1;
+    };
+
+    for (size_t i = 0; i < postfix.size(); i++) {
+        const char c = postfix[i];
+        if (IsOperand(c)) {
+            const int p = newPosition({static_cast<unsigned char>(c), static_cast<unsigned char>(c)});
+            sets.push({false, {p}, {p}});
+        } else if (c == '[') {
+            PositionSets operand{false, {}, {}};
+            map<tuple<unsigned char, unsigned char, int>, int> suffixes; // -1: the end of the class
+            for (const ByteSequence& sequence : ReadClass(postfix, i)) {
+                int next = -1;
+                for (size_t k = sequence.size(); k-- > 0;) {
+                    const auto key = make_tuple(sequence[k].low, sequence[k].high, next);
+                    auto it = suffixes.find(key);
+                    if (it == suffixes.end()) {
+                        const int p = newPosition(sequence[k]);
+                        if (next < 0)
+                            operand.last.push_back(p);
+                        else
+                            follow[p].push_back(next);
+                        it = suffixes.emplace(key, p).first;
+                    }
+                    next = it->second;
+                }
+                if (find(operand.first.begin(), operand.first.end(), next) == operand.first.end())
+                    operand.first.push_back(next);
+            }
+            sets.push(std::move(operand));
+        } else if (c == '*') {
+            PositionSets& a = sets.top();
+            for (const int l : a.last)
+                follow[l].insert(follow[l].end(), a.first.begin(), a.first.end());
+            a.nullable = true;
+        } else if (c == '.' || c == '|') {
+            PositionSets b = sets.top();
+            sets.pop();
+            PositionSets& a = sets.top();
+            if (c == '.') {
+                for (const int l : a.last)
+                    follow[l].insert(follow[l].end(), b.first.begin(), b.first.end());
+                if (a.nullable)
+                    a.first.insert(a.first.end(), b.first.begin(), b.first.end());
+                if (b.nullable)
+                    b.last.insert(b.last.end(), a.last.begin(), a.last.end());
+                a.last = std::move(b.last);
+                a.nullable = a.nullable && b.nullable;
+            } else {
+                a.first.insert(a.first.end(), b.first.begin(), b.first.end());
+                a.last.insert(a.last.end(), b.last.begin(), b.last.end());
+                a.nullable = a.nullable || b.nullable;
+            }
         }
     }
 
-    return nfa_stack.top();
-}
\ No newline at end of file
+    follow[0] = std::move(sets.top().first);
+    positions.last = std::move(sets.top().last);
+    positions.nullable = sets.top().nullable;
+    return positions;
+}
+
+//---------------------------------------------------------------------
+// convert a regular expression in postfix to an NFA using Glushkov's
+// position automaton, so the result has no epsilon moves at all
+//---------------------------------------------------------------------
+NFA PostfixToGlushkovNFA(const string& postfix) {
+    const PositionAutomaton positions = PostfixToPositions(postfix);
+
+    // a move into position p is always on one of p's bytes
+    NFA nfa;
+    nfa.SetInitialState(0);
+    for (size_t src = 0; src < positions.follow.size(); src++) {
+        for (const int p : positions.follow[src]) {
+            for (int b = positions.symbol[p].low; b <= positions.symbol[p].high; b++) {
+                nfa.AddTransition(static_cast<int>(src), {p}, static_cast<char>(b));
+                nfa.AddSymbol(static_cast<char>(b));
+            }
+        }
+    }
+    for (const int l : positions.last)
+        nfa.AddFinalState(l);
+    if (positions.nullable)
+        nfa.AddFinalState(0);
+    return nfa;
+}
@@ -2,9 +2,24 @@
 #define SHUNTING_H
 
 #include <string>
+#include <vector>
 #include "NFA.h"
 
+// empty if the regex is malformed
 std::string InfixToPostfix(const std::string& infix);
 NFA PostfixToNFA(const std::string& postfix);
+NFA PostfixToGlushkovNFA(const std::string& postfix);
+
+// Glushkov's position automaton: position 0 is initial, each other one is a
+// symbol occurrence (a byte range, for a class). follow[p] lists the positions
+// reachable from p in one move
+struct PositionAutomaton {
+    std::vector<ByteRange> symbol; // bytes entering each position
+    std::vector<std::vector<int>> follow;
+    std::vector<int> last;    // final positions, besides 0 when nullable
+    bool nullable = false;
+};
+
+PositionAutomaton PostfixToPositions(const std::string& postfix);
 
 #endif // SHUNTING_H
\ No newline at end of file